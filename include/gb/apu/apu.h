@@ -1,10 +1,16 @@
 #pragma once
 
+#include "blip_buffer.h"
+#include "resampler.h"
+#include <gb/consts.h>
 #include <gb/memory/memory_map.h>
+#include <gb/utils/bitops.h>
 #include <gb/utils/log.h>
+#include <gb/utils/state_io.h>
 
 #include <array>
 #include <cstdint>
+#include <limits>
 #include <span>
 #include <sstream>
 
@@ -22,13 +28,13 @@ namespace gb::apu {
 //      then scaled by volume register (x1-8 = 0-3840)
 // 2. resample to output freq
 // 3. scaled by volume knob (TODO - use emulator setting here)
-// 4. high pass filter
+// 4. high pass filter (capacitor charge factor 0.999958 per tclk)
 
-// current SW behavior:
-// 1. accumulate samples into a single bucket at each tclk, samples come from step 1 above
-//   - note, this will mean some samples are smaller, but I think this is fine because harmonics are outside audible range?
-// 2. scale above integer by volume knob and high pass filter
-// 3. push out sample
+// current SW behavior (same idea as SameBoy):
+// 1. channels are stepped from event to event (frequency timer expiring, frame sequencer), not every tclk.
+// 2. whenever the mixed output level changes, the delta is handed to a BlipBuffer with its exact tclk timestamp.
+// 3. BlipBuffer turns deltas into band-limited steps at a fixed INTERNAL_SAMPLE_RATE, and applies the high pass filter.
+// 4. a Resampler takes that to the output rate (host rate, nudged by rate control, divided by the fast forward speed).
 
 constexpr std::array<uint8_t, 4> PULSE_DUTY_CYCLES{
 	0b1111'1110, 0b0111'1110, 0b0111'1000, 0b1000'0001
@@ -40,7 +46,7 @@ constexpr uint16_t NR10{0xFF10}, NR11{0xFF11}, NR12{0xFF12}, NR13{0xFF13}, NR14{
 constexpr uint16_t NR21{0xFF16}, NR22{0xFF17}, NR23{0xFF18}, NR24{0xFF19};
 constexpr uint16_t NR30{0xFF1A}, NR31{0xFF1B}, NR32{0xFF1C}, NR33{0xFF1D}, NR34{0xFF1E};
 constexpr uint16_t NR41{0xFF20}, NR42{0xFF21}, NR43{0xFF22}, NR44{0xFF23};
-constexpr uint16_t NR50{0xFF26}, NR51{0xFF25}, NR52{0xFF26};
+constexpr uint16_t NR50{0xFF24}, NR51{0xFF25}, NR52{0xFF26};
 constexpr uint16_t WAVETABLE_RAM_BEGIN{0xFF30}, WAVETABLE_RAM_END{0xFF40};
 }
 
@@ -65,83 +71,215 @@ constexpr std::array<uint8_t, addrs::WAVETABLE_RAM_BEGIN - addrs::AUDIOS_BEGIN>
 
 // driven by MMU, as things are triggered by writes
 struct APU {
+	constexpr static double DEFAULT_SAMPLE_RATE = 48'000;
+	constexpr static double INTERNAL_SAMPLE_RATE = consts::TCLK_HZ / 64; // 65536 Hz
+	constexpr static unsigned DIV_TCLKS = 256; // DIV ticks every 64 mclks
+	constexpr static unsigned FRAME_SEQUENCER_TCLKS = 32 * DIV_TCLKS; // 512 Hz, see set_div()
+
 	APU() {
 		reset();
 	}
 
-	void reset() {
-		log_debug("Resetting APU");
+	void reset();
 
-		// init memory and regs
-		using namespace addrs;
-		reg<NR52>() = 0; // turn APU off
-		// kind of a hack - write 0 to all regs as proxy for resetting
-		for(auto addr = NR10; addr < NR52; ++addr) {
-			write(addr, 0);
-		}
-	}
-
-	void tclk_tick() {
-		using namespace addrs;
-		if(!apu_enabled()) {
-			return;
-		}
-	}
+	// bring the APU up to the given time (tclks since power on).
+	// the APU doesn't run on its own: the MMU calls this before any audio register access, and the emulator at the end of each frame.
+	// in between, channels whose waveform can't be heard (DAC off, not panned, silent) are advanced in closed form.
+	void run_until(uint64_t clock);
 
 	uint8_t read(uint16_t addr) const {
 		using namespace addrs;
 		if(addr < AUDIOS_BEGIN || addr >= AUDIOS_END) throw_exc();
 		if(addr >= WAVETABLE_RAM_BEGIN) {
 			return wave_table[addr - WAVETABLE_RAM_BEGIN];
+		} else if(addr == NR52) {
+			return static_cast<uint8_t>((audio_regs[NR52 - AUDIOS_BEGIN] & 0x80) | AUDIO_REG_READBACK_MASKS[NR52 - AUDIOS_BEGIN]
+				| pulse[0].enabled | (pulse[1].enabled << 1) | (wave.enabled << 2) | (noise.enabled << 3));
 		} else {
 			auto idx = addr - AUDIOS_BEGIN; 
 			return audio_regs[idx] | AUDIO_REG_READBACK_MASKS[idx];
 		}
 	}
 
-	void write(uint16_t addr, uint8_t data) {
-		using namespace addrs;
-		if(addr < AUDIOS_BEGIN || addr >= AUDIOS_END) throw_exc();
+	void write(uint16_t addr, uint8_t data);
 
-		if(addr >= WAVETABLE_RAM_BEGIN) {
-			wave_table[addr - WAVETABLE_RAM_BEGIN] = data;
-			return;
-		}
+	// the frame sequencer steps when bit 4 of DIV falls, i.e. every time DIV passes a multiple of 32, so it goes by
+	// where DIV is. DIV only ticks on its own from there, so the APU just needs telling when it's set from outside
+	// (other save state formats, skipping the boot ROM), and when the game writes it, see reset_div().
+	void set_div(uint64_t clock, uint8_t div);
+	// a write to DIV sets it to 0, which steps the frame sequencer if bit 4 was set.
+	void reset_div(uint64_t clock);
 
-		uint8_t& mem = audio_regs[addr - AUDIOS_BEGIN];
+	// output, as interleaved stereo int16 samples. see BlipBuffer.
+	// output samples per emulated second, so fast forwarding at n times speed wants host rate / n.
+	void set_sample_rate(double rate) { resampler.set_rates(INTERNAL_SAMPLE_RATE, rate); resampler.clear(); blip.clear(now); }
+	// like set_sample_rate(), but keeps any unread samples. for adjustments while running (rate control, changing speed).
+	void adjust_sample_rate(double rate) { resampler.set_rates(INTERNAL_SAMPLE_RATE, rate); }
+	double sample_rate() const { return resampler.out_rate(); }
+	size_t samples_available() const;
+	// read up to out.size() / 2 stereo samples (interleaved), @return number of samples (not int16s) read.
+	size_t read_samples(std::span<int16_t> out);
 
-		const bool was_enabled = apu_enabled();
-		if(addr == NR52) {
-			// always writable, even if not enabled
-			mem = data;
-			if(apu_enabled() && !was_enabled) log_info("Enabling APU");
-			else if(was_enabled && !apu_enabled()) reset();
-			return;
-		}
+	// with output off no samples are generated, and every channel is advanced in closed form.
+	// only call right after run_until(), this throws away any samples not yet read.
+	void set_output_enabled(bool enabled);
+	bool output_is_enabled() const { return output_enabled; }
 
-		if(!was_enabled) [[unlikely]] {
-			log_warn("Ignoring write to {:#06x} while APU off", addr);
-			return;
-		}
+	// for frames that get run and then thrown away (runahead): no output, and samples not yet read are left alone.
+	// on resuming, output carries on from whatever state the APU is in by then, usually one loaded from before pausing.
+	void pause_output();
+	void resume_output();
+
+	// run_until(), then settle anything owed lazily, so the same state always saves as the same bytes.
+	void sync(uint64_t clock);
+
+	// see gameboy_emulator::save_state(), sync() first. the output side (sample rate, samples not yet read) isn't saved.
+	template<typename IO>
+	void save_state(IO& io) const { serialize(*this, io); }
+	// samples not yet read are kept, and the output moves to the loaded state's level from there,
+	// so loading over and over (e.g. rewinding) doesn't leave gaps.
+	void load_state(StateReader& io);
 
-		mem = data;
-		// TODO triggering logic here
+	// last written value of a register (no readback masking), for exporting other save state formats (see bess.h).
+	uint8_t peek(uint16_t addr) const {
+		using namespace addrs;
+		if(addr < AUDIOS_BEGIN || addr >= AUDIOS_END) throw_exc();
+		return addr >= WAVETABLE_RAM_BEGIN ? wave_table[addr - WAVETABLE_RAM_BEGIN] : audio_regs[addr - AUDIOS_BEGIN];
 	}
 
 private:
+	template<typename Self, typename IO>
+	static void serialize(Self& self, IO& io) {
+		io(self.audio_regs); io(self.wave_table); io(self.now);
+		// stepping isn't saved, it depends on whether output is enabled
+		const auto common = [&io](auto& ch) { io(ch.enabled); io(ch.length); io(ch.next_clock); };
+		for(auto& ch : self.pulse) {
+			common(ch);
+			io(ch.duty_pos); io(ch.env); io(ch.shadow_freq); io(ch.sweep_timer); io(ch.sweep_enabled);
+		}
+		common(self.wave);
+		io(self.wave.pos); io(self.wave.sample);
+		common(self.noise);
+		io(self.noise.lfsr); io(self.noise.lfsr_pending); io(self.noise.env);
+		io(self.frame_sequencer_next); io(self.frame_sequencer_step); io(self.div_origin);
+	}
+
 	// get last written value (no masking)
 	template<uint16_t Addr>
-	auto& reg() {
+	uint8_t& reg() {
 		static_assert(Addr >= addrs::AUDIOS_BEGIN && Addr <= addrs::NR52);
 		return audio_regs[Addr - addrs::AUDIOS_BEGIN];
 	}
-	
+	uint8_t& reg(uint16_t addr) { return audio_regs[addr - addrs::AUDIOS_BEGIN]; }
+
+	bool apu_enabled() { return reg<addrs::NR52>() & 0x80; }
+
+	constexpr static uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+	struct envelope {
+		uint8_t volume = 0;
+		uint8_t timer = 0;
+
+		void trigger(uint8_t nrx2) {
+			volume = nrx2 >> 4;
+			timer = nrx2 & 7;
+		}
+
+		void clock(uint8_t nrx2) {
+			const uint8_t period = nrx2 & 7;
+			if(!period) return;
+			if(timer) --timer;
+			if(timer) return;
+			timer = period;
+			if(get_bit(nrx2, 3)) {
+				if(volume < 15) ++volume;
+			} else if(volume) {
+				--volume;
+			}
+		}
+	};
+
+	// common to all channels.
+	// note: timers only run while the channel is enabled.
+	struct channel {
+		bool enabled = false;
+		uint16_t length = 0; // clocks left until the channel is disabled, if length is enabled
+		uint64_t next_clock = NEVER; // when the frequency timer next runs out
+		bool stepping = false; // see update_stepping()
+
+		void clock_length(uint8_t nrx4) {
+			if(get_bit(nrx4, 6) && length && --length == 0) enabled = false;
+		}
+	};
+
+	struct pulse_channel : channel {
+		uint8_t duty_pos = 0;
+		envelope env;
+		// sweep, only on channel 1
+		uint16_t shadow_freq = 0;
+		uint8_t sweep_timer = 0;
+		bool sweep_enabled = false;
+	};
+
+	struct wave_channel : channel {
+		uint8_t pos = 0; // nibble index into wave ram
+		uint8_t sample = 0;
+	};
+
+	struct noise_channel : channel {
+		uint16_t lfsr = 0x7FFF;
+		uint64_t lfsr_pending = 0; // shifts owed while the channel couldn't be heard, done in flush_lfsr()
+		envelope env;
+	};
+
+	// registers for pulse channel i start at NR10 / NR20 (which doesn't exist, sweep is channel 1 only)
+	static uint16_t pulse_regs(unsigned i) { return static_cast<uint16_t>(addrs::NR10 + 5 * i); }
+	uint16_t pulse_freq(unsigned i) { return static_cast<uint16_t>(reg(pulse_regs(i) + 3) | ((reg(pulse_regs(i) + 4) & 7) << 8)); }
+	uint16_t wave_freq() { return static_cast<uint16_t>(reg<addrs::NR33>() | ((reg<addrs::NR34>() & 7) << 8)); }
+	uint64_t noise_period();
+
+	// advance a channel by some number of frequency timer periods.
+	void step_pulse(unsigned i, uint64_t steps);
+	void step_wave(uint64_t steps);
+	void step_noise(uint64_t steps);
+	void flush_lfsr();
+	// advance channels that aren't being stepped through every timer event before until.
+	void catch_up(uint64_t until);
+	void update_stepping();
+
+	void trigger_pulse(unsigned i);
+	void trigger_wave();
+	void trigger_noise();
+	uint16_t calc_sweep(); // may disable channel 1 on overflow
+	void clock_sweep();
+	void clock_frame_sequencer();
+
+	// push the output level to the blip buffer if it changed.
+	void update_output();
+	bool producing_output() const { return output_enabled && !output_paused; }
+
 	std::array<uint8_t, AUDIO_REG_READBACK_MASKS.size()> audio_regs{};
 	std::array<uint8_t, addrs::WAVETABLE_RAM_END - addrs::WAVETABLE_RAM_BEGIN> wave_table{}; // TODO: supposedly this should be uninitialized memory
 
-	bool apu_enabled() { return reg<addrs::NR52>() & 0x80; }
+	uint64_t now = 0;
+	std::array<pulse_channel, 2> pulse;
+	wave_channel wave;
+	noise_channel noise;
+	uint64_t frame_sequencer_next = NEVER;
+	uint8_t frame_sequencer_step = 0;
+	uint8_t div_origin = 0; // DIV is (clock / DIV_TCLKS - div_origin) mod 256. not reset with the APU, DIV isn't the APU's
+
+	uint8_t div_at(uint64_t clock) const { return static_cast<uint8_t>(clock / DIV_TCLKS - div_origin); }
+	// when DIV's bit 4 next falls, after clock
+	uint64_t next_div_edge(uint64_t clock) const { return (clock / DIV_TCLKS + 32 - (div_at(clock) & 31)) * DIV_TCLKS; }
+
+	bool output_enabled = true;
+	bool output_paused = false;
+	int32_t output_l = 0, output_r = 0;
+	BlipBuffer blip{consts::TCLK_HZ, INTERNAL_SAMPLE_RATE};
+	Resampler resampler{INTERNAL_SAMPLE_RATE, DEFAULT_SAMPLE_RATE};
 
 	// TODO: cgb audio sampling
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace gb::apu {
+
+// band-limited step synthesis, in the style of blip_buf (used by SameBoy, Gambatte, ...).
+// instead of sampling the channels every tclk, the APU only reports when its output level changes (a delta, at a clock timestamp).
+// each delta is added to the buffer as a windowed-sinc impulse, and reading integrates the buffer,
+// so every level change comes out as a band-limited step and samples are generated directly at the output rate.
+// stereo, output is interleaved int16 with a high pass filter applied.
+class BlipBuffer {
+public:
+	BlipBuffer(double clock_rate, double sample_rate);
+
+	// changing rates drops any unread samples.
+	void set_rates(double clock_rate, double sample_rate);
+	double sample_rate() const { return sample_rate_; }
+
+	// drop everything, and restart with clock as the time of the first sample.
+	void clear(uint64_t clock = 0);
+	// carry on from the last end_frame() as if it had been at clock, keeping unread samples and the output level.
+	// for when the emulated clock jumps (loading a save state).
+	void set_clock(uint64_t clock) { frame_clock = clock; }
+
+	// the output level changed by delta (in int16 units) at clock, which must not be before the last end_frame().
+	void add_delta(uint64_t clock, int32_t delta_l, int32_t delta_r);
+
+	// no more deltas will be added before clock, so samples up to there can be read.
+	// if nobody is reading, the oldest samples are dropped past MAX_BUFFERED_SECONDS.
+	void end_frame(uint64_t clock);
+
+	size_t samples_available() const { return static_cast<size_t>(frame_pos >> FRAC_BITS); }
+
+	// read up to out.size() / 2 stereo samples, @return number of samples (not int16s) read.
+	size_t read_samples(std::span<int16_t> out);
+
+	// drop samples without reading them (filter state is still updated).
+	void skip_samples(size_t count);
+
+	constexpr static double MAX_BUFFERED_SECONDS = 0.5;
+
+private:
+	constexpr static unsigned FRAC_BITS = 32;
+
+	void remove_samples(size_t count);
+	void integrate(size_t count, int16_t* out);
+
+	double clock_rate_;
+	double sample_rate_;
+	uint64_t factor = 0; // samples per clock, FRAC_BITS fixed point
+	float high_pass_charge = 0;
+
+	uint64_t frame_clock = 0; // clock at the last end_frame()
+	uint64_t frame_pos = 0; // position of frame_clock in samples from the start of the buffer, FRAC_BITS fixed point
+
+	// deltas (scaled by the kernel), not yet integrated
+	std::vector<int64_t> buf_l, buf_r;
+	size_t used_end = 0; // everything in buf_l/buf_r from here on is 0
+	int64_t sum_l = 0, sum_r = 0; // integrator
+	float capacitor_l = 0, capacitor_r = 0; // high pass filter
+};
+
+}
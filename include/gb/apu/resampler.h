@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace gb::apu {
+
+// stereo polyphase windowed-sinc resampler, for going from the APU's fixed internal rate to whatever the host wants
+// (44.1k, 48k, 96k, or a fraction of that when fast forwarding, which makes this a decimator).
+// the filter is a table of PHASES sub-sample offsets, linearly interpolated, so any ratio works and can change while running.
+// when downsampling the cutoff drops with the output rate (and the filter gets longer) so nothing aliases.
+// samples are kept planar (one buffer per channel) so both channels share each coefficient load, with SSE2/AVX2 kernels.
+class Resampler {
+public:
+	Resampler(double in_rate, double out_rate);
+
+	// keeps buffered input: small changes (dynamic rate control) only change the step,
+	// the filter is only rebuilt if the cutoff moves noticeably.
+	void set_rates(double in_rate, double out_rate);
+	double in_rate() const { return in_rate_; }
+	double out_rate() const { return out_rate_; }
+
+	// drop all buffered input.
+	void clear();
+
+	// append interleaved stereo input.
+	void write(std::span<const int16_t> in);
+
+	// output samples that can be read from what's been written so far.
+	size_t samples_available() const;
+	// input samples needed for this many more output samples than are available.
+	size_t input_needed(size_t out_samples) const;
+
+	// read up to out.size() / 2 stereo samples (interleaved), @return number of samples (not int16s) read.
+	size_t read_samples(std::span<int16_t> out);
+
+private:
+	constexpr static unsigned PHASES = 64;
+	constexpr static unsigned FRAC_BITS = 32;
+	constexpr static unsigned BASE_TAPS = 32; // at or above 1:1, longer when downsampling
+	constexpr static unsigned MAX_TAPS = 1024; // covers 32x decimation
+
+	void build_filter(double cutoff);
+
+	double in_rate_ = 0, out_rate_ = 0;
+	uint64_t step = 0; // input samples per output sample, FRAC_BITS fixed point
+	uint64_t pos = 0; // first input sample under the filter for the next output, FRAC_BITS fixed point
+
+	double cutoff_ = 0; // as a fraction of the input nyquist rate
+	unsigned taps = 0; // multiple of 8
+	// per phase: taps coefficients, then taps deltas to the next phase
+	std::vector<float> filter;
+
+	std::vector<float> buf_l, buf_r;
+
+	using kernel_fn = void(*)(const float* l, const float* r, const float* coef, unsigned taps, float frac, float& out_l, float& out_r);
+	kernel_fn kernel;
+};
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <gb/gb.h>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace gb::bess {
+
+// save states in SameBoy's BESS format (https://github.com/LIJI32/SameBoy/blob/master/BESS.md), for keeping them
+// around and for trading them with other emulators.
+// BESS leaves the start of the file to the emulator, so ours (see gameboy_emulator::save_state()) goes there, and a file
+// saved by this build with this cartridge loads back exactly. anything else is loaded from the BESS blocks, which don't
+// have our internal state: the PPU starts the current line over, and audio channels that were playing are retriggered.
+
+std::vector<uint8_t> export_state(gameboy_emulator& emulator);
+
+// on failure (not BESS, another model or cartridge), nothing is changed.
+void import_state(gameboy_emulator& emulator, std::span<const uint8_t> data);
+
+}
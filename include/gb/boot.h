@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace gb {
+
+// the boot ROM argument the UIs take: a file, or "-" for none, in which case the emulator starts where the boot ROM
+// would have left off (see gameboy_emulator's constructor), so the DMG's doesn't have to be at hand.
+std::vector<uint8_t> load_boot_rom(std::string_view arg);
+
+}
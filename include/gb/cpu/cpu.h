@@ -2,6 +2,7 @@
 
 #include <gb/memory/mmu.h>
 #include <gb/utils/log.h>
+#include <gb/utils/state_io.h>
 
 #include "regs.h"
 
@@ -490,7 +491,32 @@ struct CPU {
 		);
 	}
 
+	// see gameboy_emulator::save_state(). the coverage bitsets only feed debug logging, so they aren't saved.
+	template<typename IO>
+	void save_state(IO& io) const { serialize(*this, io); }
+	void load_state(StateReader& io) { serialize(*this, io); }
+
+	// for importing/exporting other formats (see bess.h).
+	struct registers {
+		uint16_t af, bc, de, hl, sp, pc;
+		bool ime;
+		bool halted;
+	};
+	registers get_registers() const { return {af, bc, de, hl, sp, pc, IME, halted}; }
+	void set_registers(const registers& r) {
+		af = r.af; bc = r.bc; de = r.de; hl = r.hl; sp = r.sp; pc = r.pc;
+		IME = r.ime;
+		IME_enable_pending = false;
+		halted = r.halted;
+	}
+
 private:
+	template<typename Self, typename IO>
+	static void serialize(Self& self, IO& io) {
+		io(self.af); io(self.bc); io(self.de); io(self.hl); io(self.sp); io(self.pc);
+		io(self.IME); io(self.IME_enable_pending); io(self.halted);
+	}
+
 	// regs - TODO seed if needed.
 	Reg16 af{0xCA00}, bc{0xCAFE}, de{0xCAFE}, hl{0xCAFE};
 	Reg16 sp{0xCAFE}, pc{};
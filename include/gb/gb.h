@@ -1,12 +1,25 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include <gb/consts.h>
 #include <gb/cpu/cpu.h>
 #include <gb/memory/mmu.h>
 #include <gb/memory/serial.h>
 #include <gb/ppu/ppu.h>
+#include <gb/ppu/observation.h>
+#include <gb/ppu/packed_frame.h>
 #include <gb/apu/apu.h>
+#include <gb/utils/hash.h>
 #include <gb/utils/log.h>
+#include <gb/utils/state_io.h>
 
 namespace gb
 {
@@ -15,8 +28,56 @@ namespace gb
 struct gameboy_emulator : SerialIO
 {
 	gameboy_emulator(std::vector<uint8_t> boot_rom, std::vector<uint8_t> cartridge_rom, std::optional<std::vector<uint8_t>> save_data)
-		: mmu{std::move(boot_rom), std::move(cartridge_rom), std::move(save_data), joypad, apu}
+		: gameboy_emulator(boot_rom, std::make_shared<const std::vector<uint8_t>>(std::move(cartridge_rom)), save_data)
+	{
+	}
+
+	// for many emulators of the same game, without a copy of the ROM each.
+	// with no boot ROM (empty), the emulator starts where the DMG's would leave off instead, see skip_boot().
+	gameboy_emulator(std::span<const uint8_t> boot_rom, memory::SharedRom cartridge_rom, std::optional<std::span<const uint8_t>> save_data)
+		: mmu{boot_rom.empty() ? std::span<const uint8_t>{NO_BOOT_ROM} : boot_rom, std::move(cartridge_rom), save_data, joypad, apu}
 	{
+		if(boot_rom.empty()) {
+			skip_boot();
+			std::call_once(boot_cache->booted, [this]{ boot_cache->post_boot = save_state(); });
+		} else {
+			boot_cache->power_on = save_state();
+		}
+	}
+
+	// a new emulator in the same state, sharing the ROM. the rest (~40KB) is copied through a save state, so this costs
+	// about a save_state() and a load_state() on top of constructing one.
+	// only the state comes along, not settings (renderer, frame skip, audio output) or connections (input source, serial).
+	std::unique_ptr<gameboy_emulator> clone() {
+		std::unique_ptr<gameboy_emulator> ret{new gameboy_emulator{clone_tag{}, *this}};
+		ret->load_state(save_state());
+		return ret;
+	}
+
+	// back to just after the boot ROM, as if the power had been cycled, for starting episodes/test runs over without
+	// constructing a new emulator. cartridge RAM goes back to what it was when this was constructed (or cloned from).
+	// the first reset of an emulator and its clones runs the boot ROM from power on (a couple of seconds emulated, with
+	// the audio output paused) and keeps where it ends up, after that it's a load_state(), a few µs.
+	// settings and connections stay as they are.
+	void reset() {
+		std::call_once(boot_cache->booted, [this]{
+			load_state(boot_cache->power_on);
+			apu.pause_output();
+			try {
+				const auto start = total_mclks;
+				while(mmu.get_boot_rom_enabled()) {
+					if(total_mclks - start > BOOT_TIMEOUT_MCLKS) throw_exc("Boot ROM didn't finish in {} mclks", BOOT_TIMEOUT_MCLKS);
+					step();
+				}
+				apu.run_until(total_tclks);
+			} catch (...) {
+				apu.resume_output();
+				throw;
+			}
+			apu.resume_output();
+			boot_cache->post_boot = save_state();
+		});
+		load_state(boot_cache->post_boot);
 	}
 
 	void run_frame() {
@@ -25,17 +86,9 @@ struct gameboy_emulator : SerialIO
 			bool vblank_finished = false;
 			while(!(vblank_finished && ppu.mode() == ppu::Mode::VBLANK)) {
 				if(ppu.mode() != ppu::Mode::VBLANK) vblank_finished = true;
-				const auto cpu_mclks = cpu.fetch_execute();
-				const auto old_mclks = total_mclks;
-				total_mclks += cpu_mclks;
-				mmu.handle_timers(old_mclks, total_mclks);
-				const auto cpu_tclks = cpu_mclks * 4; // TODO not true for CGB - APU/GPU run at const speed
-				total_tclks += cpu_tclks;
-				for(int i = 0; i<cpu_tclks; i++) {
-					ppu.tclk_tick();
-					apu.tclk_tick();
-				}
+				step();
 			}
+			apu.run_until(total_tclks); // otherwise the APU only runs when its registers are accessed
 		} catch (...) {
 			log_error("Exception raised, dumping state:\n{}", dump_state());
 			log_debug("frame:");
@@ -73,14 +126,123 @@ struct gameboy_emulator : SerialIO
 		joypad.release(released);
 	}
 
+	// all the buttons at once, as a bitmask: bit i set if joypad_bits i is pressed.
+	uint8_t held_buttons() const {
+		uint8_t ret = 0;
+		for(uint8_t i = 0; i < 8; ++i) {
+			if(joypad.read_button(static_cast<joypad::joypad_bits>(i))) ret |= static_cast<uint8_t>(1 << i);
+		}
+		return ret;
+	}
+
+	void set_buttons(uint8_t held) {
+		for(uint8_t i = 0; i < 8; ++i) {
+			const auto button = static_cast<joypad::joypad_bits>(i);
+			const bool pressed = (held >> i) & 1;
+			if(pressed == joypad.read_button(button)) continue;
+			if(pressed) press(button);
+			else release(button);
+		}
+	}
+
+	// latch input at the moment the game reads it, see joypad::InputSource. the source calls press()/release().
+	void set_input_source(joypad::InputSource* source) { mmu.set_input_source(source); }
+
 	// for debug
 	const joypad::Joypad& get_joypad() const { return joypad; }
 
+	// interleaved stereo samples generated so far, see apu::APU::read_samples.
+	size_t read_audio(std::span<int16_t> out) {
+		apu.run_until(total_tclks);
+		return apu.read_samples(out);
+	}
+
+	// copy the current frame out in the given format, see ppu::export_frame.
+	void export_frame(ppu::FrameFormat format, std::span<uint8_t> out) const {
+		ppu::export_frame(ppu.cur_frame(), format, out);
+	}
+
+	// write an observation of the current frame into out, see ppu::Observer.
+	void observe(ppu::Observer& observer, std::span<uint8_t> out) const {
+		observer.write(ppu.cur_frame(), out);
+	}
+
 	// external gameboy requests to shift out a byte, return byte from memory to shift in
 	uint8_t handle_serial_transfer([[maybe_unused]] uint8_t value, [[maybe_unused]] uint32_t baud) final {
 		throw_exc();
 	}
 
+	// save states: everything needed to carry on exactly from here, as state_size() flat bytes. fast enough to save/load
+	// every frame. they only load into the same build with the same cartridge (checked), see bess.h to keep them around.
+	// saving brings the APU up to date first, so the same state always saves as the same bytes.
+	size_t state_size() const {
+		StateSizer sizer;
+		write_state(sizer);
+		return sizer.size();
+	}
+
+	// which of those bytes are memory, see StateLayout.
+	StateLayout state_layout() const {
+		StateLayout layout;
+		write_state(layout);
+		return layout;
+	}
+
+	void save_state(std::span<uint8_t> out) {
+		apu.sync(total_tclks);
+		StateWriter writer{out};
+		write_state(writer);
+	}
+
+	std::vector<uint8_t> save_state() {
+		std::vector<uint8_t> ret(state_size());
+		save_state(ret);
+		return ret;
+	}
+
+	// whether load_state() would accept in.
+	bool can_load_state(std::span<const uint8_t> in) const {
+		if(in.size() != state_size()) return false;
+		StateReader reader{in};
+		state_header header;
+		reader(header);
+		return header == make_state_header();
+	}
+
+	// on failure (the state is from another build or cartridge), nothing is changed.
+	void load_state(std::span<const uint8_t> in) {
+		if(!can_load_state(in)) throw_exc("Save state of {} bytes doesn't match this build and cartridge", in.size());
+		StateReader reader{in};
+		state_header header;
+		reader(header);
+		cpu.load_state(reader);
+		mmu.load_state(reader); // before the PPU, which looks at LY
+		ppu.load_state(reader);
+		apu.load_state(reader);
+		joypad.load_state(reader);
+		reader(total_mclks);
+		reader(total_tclks);
+	}
+
+#if GB_STATE_HASH
+	// a hash of everything save_state() has except the picture, cheap enough to take every frame: memory is hashed as
+	// it's written (see MMU::memory_hash()), so only the registers (a few hundred bytes) are hashed here.
+	// equal for equal states within a run, like fast_hash(), so don't store it.
+	uint64_t state_hash() {
+		apu.sync(total_tclks);
+		StateHasher hasher;
+		cpu.save_state(hasher);
+		mmu.hash_registers(hasher);
+		ppu.save_state_without_frame(hasher);
+		apu.save_state(hasher);
+		joypad.save_state(hasher);
+		hasher(total_mclks);
+		hasher(total_tclks);
+		hasher(mmu.memory_hash());
+		return hasher.digest();
+	}
+#endif
+
 	// for UI and debugging
 	std::string dump_state() const {
 		return std::format("CPU state:\n{}\nPPU state:\n{}", cpu.dump_state(), ppu.dump_state());
@@ -88,7 +250,82 @@ struct gameboy_emulator : SerialIO
 
 	void connect_serial(SerialIO& conn) { mmu.connect_serial(conn); }
 
+	// identifies the game, for files that only go with it (movies, save state files). hashes the whole ROM, so keep it around.
+	uint64_t rom_hash() const {
+		Fnv1a64 hash;
+		hash.update(mmu.get_cartridge().raw_rom());
+		return hash.digest();
+	}
+
+	// bump when anything saved changes
+	constexpr static uint32_t STATE_VERSION = 3;
+
 private:
+	// for clone(): shares from's boot states for reset() rather than setting up its own (booting or saving a state),
+	// everything else is loaded after.
+	struct clone_tag {};
+	gameboy_emulator(clone_tag, const gameboy_emulator& from)
+		: boot_cache{from.boot_cache}, mmu{from.mmu.raw_boot_rom(), from.mmu.get_cartridge().shared_rom(), std::nullopt, joypad, apu}
+	{
+	}
+
+	// an instruction, and everything else for as long as it takes
+	void step() {
+		const auto cpu_mclks = cpu.fetch_execute();
+		const auto old_mclks = total_mclks;
+		total_mclks += cpu_mclks;
+		mmu.handle_timers(old_mclks, total_mclks);
+		const auto cpu_tclks = cpu_mclks * 4; // TODO not true for CGB - APU/GPU run at const speed
+		total_tclks += cpu_tclks;
+		for(int i = 0; i<cpu_tclks; i++) {
+			ppu.tclk_tick();
+		}
+	}
+
+	// what the DMG boot ROM leaves behind (registers, the logo in VRAM), set directly. in boot.cpp.
+	void skip_boot();
+
+	// stands in for the boot ROM when there isn't one, it's disabled before anything runs
+	constexpr static std::array<uint8_t, memory::addrs::BOOT_ROM_END - memory::addrs::BOOT_ROM_BEGIN> NO_BOOT_ROM{};
+	// the DMG's takes ~2.4s, anything much longer is stuck
+	constexpr static uint64_t BOOT_TIMEOUT_MCLKS = static_cast<uint64_t>(10 * consts::TCLK_HZ / 4);
+
+	// for reset(), shared by an emulator and its clones: they're all the same game, with the same boot ROM.
+	struct boot_states {
+		std::vector<uint8_t> power_on; // empty when skipping the boot ROM
+		std::once_flag booted;
+		std::vector<uint8_t> post_boot;
+	};
+	std::shared_ptr<boot_states> boot_cache = std::make_shared<boot_states>();
+
+	struct state_header {
+		char magic[4];
+		uint32_t version;
+		uint32_t cartridge_checksum; // 32 bits so there's no padding
+		bool operator==(const state_header&) const = default;
+	};
+
+	state_header make_state_header() const {
+		const auto& cartridge = mmu.get_cartridge();
+		return {
+			.magic = {'G', 'B', 'S', 'S'},
+			.version = STATE_VERSION,
+			.cartridge_checksum = static_cast<uint32_t>((cartridge.read(memory::addrs::GLOBAL_CHECKSUM) << 8) | cartridge.read(memory::addrs::GLOBAL_CHECKSUM + 1)),
+		};
+	}
+
+	template<typename IO>
+	void write_state(IO& io) const {
+		io(make_state_header());
+		cpu.save_state(io);
+		mmu.save_state(io);
+		ppu.save_state(io);
+		apu.save_state(io);
+		joypad.save_state(io);
+		io(total_mclks);
+		io(total_tclks);
+	}
+
 	joypad::Joypad joypad;
 public:
 	apu::APU apu{};
@@ -101,4 +338,14 @@ public:
 
 };
 
+// copy the current frame of each emulator into one contiguous buffer.
+// frame i is written at offset i * frame_bytes(format).
+inline void export_frames(std::span<const gameboy_emulator* const> emulators, ppu::FrameFormat format, std::span<uint8_t> out) {
+	const auto stride = ppu::frame_bytes(format);
+	if(out.size() < emulators.size() * stride) throw_exc("Buffer of {} bytes too small for {} frames", out.size(), emulators.size());
+	for(size_t i = 0; i < emulators.size(); ++i) {
+		emulators[i]->export_frame(format, out.subspan(i * stride, stride));
+	}
+}
+
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <gb/utils/state_io.h>
+
 #include <array>
 #include <cstdint>
 #include <format>
@@ -30,10 +32,23 @@ struct Joypad {
 
     void release(joypad_bits released);
 
+    template<typename IO>
+    void save_state(IO& io) const { io(values); }
+    void load_state(StateReader& io) { io(values); }
+
 private:
     uint8_t values{0xFF};
 };
 
+// delivers input right when the game reads the joypad, instead of once per frame, see MMU::set_input_source().
+// games usually read it once a frame, so this is the latest point input can make it into that frame.
+struct InputSource {
+    virtual ~InputSource() = default;
+
+    // the game is reading the joypad at emulated mclk: press/release whatever has come in since the last call.
+    virtual void poll(uint64_t mclk) = 0;
+};
+
 } // ns gb::joypad
 
 template<>
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <gb/memory/memory_map.h>
+#include <gb/memory/cartridge/shared_rom.h>
 #include <gb/memory/cartridge/mappers/mbc1.h>
 #include <gb/memory/cartridge/mappers/no_mapper.h>
+#include <gb/utils/state_io.h>
 
 #include <cstdint>
 #include <optional>
@@ -10,19 +12,37 @@
 #include <vector>
 #include <span>
 #include <string>
+#include <utility>
 
 
 namespace gb::memory {
 
 template<typename T>
-concept Mapper = requires(std::span<const uint8_t> rom, std::optional<std::span<const uint8_t>> save_data, T mapper) {
+concept Mapper = requires(SharedRom rom, std::optional<std::span<const uint8_t>> save_data, T mapper, StateWriter writer, StateReader reader) {
 	requires std::constructible_from<T, decltype(rom), decltype(save_data)>;
 
 	{ mapper.read(uint16_t{}) } -> std::same_as<uint8_t>;
 	{ mapper.write(uint16_t{}, uint8_t{}) } -> std::same_as<void>;
 
+	// the 256 contiguous bytes that the page starting at addr (a multiple of 256) currently maps to, or nullptr if reads have side effects or aren't backed by memory.
+	// used for bulk copies like OAM DMA, and for tracking writes to RAM (see MMU::memory_hash()): RAM that's mapped in has to show up here.
+	{ std::as_const(mapper).page(uint16_t{}) } -> std::same_as<const uint8_t*>;
+
 	// for save RAM
 	{ std::as_const(mapper).dump_save_data() } -> std::convertible_to<std::optional<std::vector<uint8_t>>>;
+
+	// for save states: registers and RAM, see gameboy_emulator::save_state()
+	{ std::as_const(mapper).save_state(writer) } -> std::same_as<void>;
+	{ mapper.load_state(reader) } -> std::same_as<void>;
+
+	// for importing/exporting other save state formats (see bess.h): all of the cartridge's RAM regardless of banking,
+	// and the writes to registers that bring a freshly constructed mapper to its current state.
+	{ std::as_const(mapper).raw_ram() } -> std::same_as<std::span<const uint8_t>>;
+	{ mapper.raw_ram() } -> std::same_as<std::span<uint8_t>>;
+	{ std::as_const(mapper).register_writes() } -> std::same_as<std::vector<std::pair<uint16_t, uint8_t>>>;
+
+	// the whole ROM, to share with clones (see gameboy_emulator::clone()), or e.g. to tell which game an input recording is for (see movie.h)
+	{ std::as_const(mapper).shared_rom() } -> std::same_as<const SharedRom&>;
 	
 	// TODO: for debugging mappers
 	// { std::as_const(mapper).dump_state() } -> std::string;
@@ -37,14 +57,25 @@ class Cartridge {
 
 public: 
 	// TODO save data.
-	Cartridge(std::span<const uint8_t> rom, std::optional<std::span<const uint8_t>> save_data);
+	Cartridge(SharedRom rom, std::optional<std::span<const uint8_t>> save_data);
 
 	// for GB
 	uint8_t read(uint16_t addr) const { return std::visit([addr](const auto& mapper){return mapper.read(addr); }, mapper_variant); };
 	void write(uint16_t addr, uint8_t data) { std::visit([addr, data](auto& mapper){mapper.write(addr, data);}, mapper_variant); };
+	const uint8_t* page(uint16_t addr) const { return std::visit([addr](const auto& mapper){return mapper.page(addr); }, mapper_variant); };
 
 	auto dump_save_data() const { return std::visit([](auto mapper) -> std::optional<std::vector<uint8_t>> { return mapper.dump_save_data(); }, mapper_variant); }
 
+	// for save states, see Mapper
+	template<typename IO>
+	void save_state(IO& io) const { std::visit([&io](const auto& mapper){ mapper.save_state(io); }, mapper_variant); }
+	void load_state(StateReader& io) { std::visit([&io](auto& mapper){ mapper.load_state(io); }, mapper_variant); }
+	std::span<const uint8_t> raw_ram() const { return std::visit([](const auto& mapper){ return mapper.raw_ram(); }, mapper_variant); }
+	std::span<uint8_t> raw_ram() { return std::visit([](auto& mapper){ return mapper.raw_ram(); }, mapper_variant); }
+	auto register_writes() const { return std::visit([](const auto& mapper){ return mapper.register_writes(); }, mapper_variant); }
+	const SharedRom& shared_rom() const { return std::visit([](const auto& mapper) -> const SharedRom& { return mapper.shared_rom(); }, mapper_variant); }
+	std::span<const uint8_t> raw_rom() const { return *shared_rom(); }
+
 	// for external (not by the emulated CPU) use
 	std::string title() const {
 		std::string ret;
@@ -2,6 +2,8 @@
 
 #include <gb/utils/log.h>
 #include <gb/memory/memory_map.h>
+#include <gb/memory/cartridge/shared_rom.h>
+#include <gb/utils/state_io.h>
 
 #include <algorithm>
 #include <array>
@@ -9,11 +11,12 @@
 #include <optional>
 #include <vector>
 #include <span>
+#include <utility>
 
 namespace gb::memory::mappers {
 
 struct MBC1 {
-	MBC1(std::span<const uint8_t> romIn, std::optional<std::span<const uint8_t>> save_data): rom{romIn.begin(), romIn.end()} {
+	MBC1(SharedRom romIn, std::optional<std::span<const uint8_t>> save_data): rom_owner{std::move(romIn)}, rom{*rom_owner} {
 		const auto ram_size = [ram_size_raw = rom[memory::addrs::RAM_SIZE]](){
 			switch(ram_size_raw) {
 				case 0: return 0;
@@ -32,13 +35,8 @@ struct MBC1 {
 	}
 	
 	uint8_t read(uint16_t addr) const {
-		if(addr < 0x4000) { // ROM Bank 0
-			unsigned bank = bank_mode_select ? bank_select_hi : 0;
-			auto idx = (bank << 19) | addr;
-			return rom[idx & (rom.size() - 1)];
-		} else if(addr < 0x8000) { // ROM Bank 1
-			unsigned idx = (addr & 0x3FFF) | (static_cast<unsigned>(bank_select_lo) << 14) | (static_cast<unsigned>(bank_select_hi) << 19);
-			return rom[idx & (rom.size() - 1)];
+		if(addr < 0x8000) {
+			return rom[rom_idx(addr)];
 		} else if(addr >= addrs::CARTRIDGE_RAM_BEGIN && addr < addrs::CARTRIDGE_RAM_END) {
 			if(ram.empty()) {
 				log_warn("Read from non-existent ram address {:#04x}", addr);
@@ -50,6 +48,13 @@ struct MBC1 {
 		throw_exc("Invalid read from MBC1 addr {:#06x}", addr);
 	}
 
+	const uint8_t* page(uint16_t addr) const {
+		// banks are a power of 2 in size, so a page never straddles the end of rom/ram.
+		if(addr < 0x8000) return &rom[rom_idx(addr)];
+		if(addr >= addrs::CARTRIDGE_RAM_BEGIN && addr < addrs::CARTRIDGE_RAM_END && !ram.empty() && ram_enabled) return &get_ram(addr);
+		return nullptr;
+	}
+
 	void write(uint16_t addr, uint8_t data) {
 		if(addr >= addrs::CARTRIDGE_RAM_BEGIN && addr < addrs::CARTRIDGE_RAM_END) {
 			if(ram.empty()) {
@@ -80,6 +85,23 @@ struct MBC1 {
 
 	auto dump_save_data() const { return std::nullopt; }
 
+	template<typename IO>
+	void save_state(IO& io) const { serialize(*this, io); }
+	void load_state(StateReader& io) { serialize(*this, io); }
+
+	std::span<const uint8_t> raw_ram() const { return ram; }
+	std::span<uint8_t> raw_ram() { return ram; }
+	const SharedRom& shared_rom() const { return rom_owner; }
+
+	std::vector<std::pair<uint16_t, uint8_t>> register_writes() const {
+		return {
+			{0x0000, ram_enabled ? uint8_t{0x0A} : uint8_t{0x00}},
+			{0x2000, bank_select_lo},
+			{0x4000, bank_select_hi},
+			{0x6000, static_cast<uint8_t>(bank_mode_select)},
+		};
+	}
+
 	std::string dump_state() const {
 		return std::format(
 			"bank_select_hi: {}, bank_select_lo: {}, bank_mode_select: {}, ram_enabled: {}",
@@ -88,6 +110,23 @@ struct MBC1 {
 	}
 
 private:
+	template<typename Self, typename IO>
+	static void serialize(Self& self, IO& io) {
+		io(self.bank_select_hi); io(self.bank_select_lo); io(self.bank_mode_select); io(self.ram_enabled);
+		io.bytes(self.ram);
+	}
+
+	size_t rom_idx(uint16_t addr) const {
+		if(addr < 0x4000) { // ROM Bank 0
+			unsigned bank = bank_mode_select ? bank_select_hi : 0;
+			auto idx = (bank << 19) | addr;
+			return idx & (rom.size() - 1);
+		} else { // ROM Bank 1
+			unsigned idx = (addr & 0x3FFF) | (static_cast<unsigned>(bank_select_lo) << 14) | (static_cast<unsigned>(bank_select_hi) << 19);
+			return idx & (rom.size() - 1);
+		}
+	}
+
 	const uint8_t& get_ram(uint16_t addr) const {
 		unsigned bank = bank_mode_select ? bank_select_hi : 0;
 		unsigned idx = (bank << 13) | (addr & 0x1FFF);
@@ -102,7 +141,8 @@ private:
 	bool bank_mode_select{0};
 	bool ram_enabled{false};
 
-	const std::vector<uint8_t> rom;
+	SharedRom rom_owner;
+	std::span<const uint8_t> rom;
 	std::vector<uint8_t> ram;
 };
 
@@ -2,6 +2,8 @@
 
 #include <gb/utils/log.h>
 #include <gb/memory/memory_map.h>
+#include <gb/memory/cartridge/shared_rom.h>
+#include <gb/utils/state_io.h>
 
 #include <algorithm>
 #include <array>
@@ -9,22 +11,21 @@
 #include <optional>
 #include <vector>
 #include <span>
+#include <utility>
 
 namespace gb::memory::mappers {
 
 struct NoMapper {
 	constexpr static size_t ROM_SIZE = 32'768;
 
-	NoMapper(std::span<const uint8_t> romIn, std::optional<std::span<const uint8_t>> save_data) {
+	NoMapper(SharedRom romIn, std::optional<std::span<const uint8_t>> save_data): rom_owner{std::move(romIn)}, rom{*rom_owner} {
 		if(save_data.has_value() && save_data->size() > 0) {
 			throw_exc("Received non-empty save data for NoMapper");
 		}
 
-		if(romIn.size() != 32'768) {
-			throw_exc("Received non-32k rom for NoMapper: size {}", romIn.size());
+		if(rom.size() != ROM_SIZE) {
+			throw_exc("Received non-32k rom for NoMapper: size {}", rom.size());
 		}
-
-		std::copy(romIn.begin(), romIn.end(), rom.begin());
 	}
 
 	uint8_t read(uint16_t addr) const {
@@ -35,13 +36,27 @@ struct NoMapper {
 		return rom[addr];
 	}
 
+	const uint8_t* page(uint16_t addr) const {
+		return addr < addrs::CARTRIDGE_ROM_END ? rom.data() + addr : nullptr;
+	}
+
 	void write(uint16_t addr, [[maybe_unused]] uint8_t data) {
 		log_warn("Wrote to ROM address {:#x}, ignoring", addr);
 	}
 
 	auto dump_save_data() const { return std::nullopt; }
 
-	std::array<std::uint8_t, ROM_SIZE> rom;
+	// no registers or RAM
+	template<typename IO>
+	void save_state(IO&) const {}
+	void load_state(StateReader&) {}
+	std::span<const uint8_t> raw_ram() const { return {}; }
+	std::span<uint8_t> raw_ram() { return {}; }
+	const SharedRom& shared_rom() const { return rom_owner; }
+	std::vector<std::pair<uint16_t, uint8_t>> register_writes() const { return {}; }
+
+	SharedRom rom_owner;
+	std::span<const uint8_t> rom;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace gb::memory {
+
+// cartridge ROM never changes, so emulators of the same game can share one copy (see gameboy_emulator::clone()).
+using SharedRom = std::shared_ptr<const std::vector<uint8_t>>;
+
+}
@@ -22,12 +22,15 @@ constexpr uint16_t HRAM_BEGIN{0xFF80}, HRAM_END{0xFFFF};
 constexpr uint16_t INTERRUPT_ENABLE{0xFFFF};
 
 // within cartridge
+constexpr uint16_t LOGO_BEGIN{0x0104}, LOGO_END{0x0134};
 constexpr uint16_t TITLE_BEGIN{0x0134}, TITLE_END{0x0143};
 constexpr uint16_t CGB_FLAG{0x0143};
 constexpr uint16_t CARTRIDGE_TYPE{0x0147};
 constexpr uint16_t ROM_SIZE{0x0148};
 constexpr uint16_t RAM_SIZE{0x0149};
 constexpr uint16_t ROM_VERSION{0x014C};
+constexpr uint16_t HEADER_CHECKSUM{0x014D};
+constexpr uint16_t GLOBAL_CHECKSUM{0x014E}; // 2 bytes, big endian
 
 // I/O
 constexpr uint16_t JOYPAD{0xFF00};
@@ -4,19 +4,25 @@
 #include <gb/memory/cartridge/cartridge.h>
 #include <gb/memory/memory_map.h>
 #include <gb/memory/serial.h>
+#include <gb/memory/write_log.h>
 #include <gb/consts.h>
 #include <gb/utils/log.h>
 #include <gb/utils/bitops.h>
+#include <gb/utils/hash.h>
+#include <gb/utils/state_io.h>
 #include <gb/joypad.h>
 
+#include <cstring>
 #include <optional>
+#include <utility>
 #include <span>
+#include <type_traits>
 
 namespace gb::memory {
 
 class MMU {
 public:
-	MMU(std::span<const uint8_t> boot_rom_in, std::span<const uint8_t> cartridge_rom, std::optional<std::span<const uint8_t>> save_data, joypad::Joypad& joypad, apu::APU& apu_in)
+	MMU(std::span<const uint8_t> boot_rom_in, SharedRom cartridge_rom, std::optional<std::span<const uint8_t>> save_data, joypad::Joypad& joypad, apu::APU& apu_in)
 		: apu{apu_in}, cartridge(std::move(cartridge_rom), std::move(save_data)), boot_rom(get_boot_rom(boot_rom_in)), joypad(joypad)
 	{}
 
@@ -29,6 +35,9 @@ public:
 	// TODO: more realistic access control for memory
 	uint8_t read(const uint16_t addr) const {
 		using namespace addrs;
+		if(oam_dma_active()) [[unlikely]] {
+			if(const auto conflict = oam_dma_conflict(addr)) return *conflict;
+		}
 		if(addr < CARTRIDGE_ROM_END) {
 			if(addr < BOOT_ROM_END && boot_rom_enabled) {
 				return boot_rom[addr - BOOT_ROM_BEGIN];
@@ -50,6 +59,7 @@ public:
 			const auto& mem = high_mem[addr - IO_MMAP_BEGIN];
 			switch(addr) {
 				case JOYPAD: {
+					if(input_source) input_source->poll(cur_mclks); // may press/release, so before reading the joypad
 					const auto lower_nybble = joypad.read_nybble(!get_bit(mem, 5),!get_bit(mem, 4));
 					return ((mem | 0b1100'0000) & 0xF0) | lower_nybble;
 				}
@@ -69,6 +79,7 @@ public:
 			log_warn("Read from disconnected address {:#x}", addr);
 			return 0xFF;
 		} else if (addr < AUDIOS_END) {
+			apu.run_until(cur_mclks * 4); // the APU only catches up when something looks at it
 			return apu.read(addr);
 		} else if (addr < IO_MMAP_END) {
 			const auto& mem = high_mem[addr - IO_MMAP_BEGIN];
@@ -86,18 +97,21 @@ public:
 	// write, as if from the CPU (see note on read above).
 	void write(const uint16_t addr, const uint8_t data) {
 		using namespace addrs;
+		if(oam_dma_active() && oam_dma_conflict(addr)) [[unlikely]] return; // lost, see oam_dma_conflict()
 		if(addr < CARTRIDGE_ROM_END) {
 			cartridge.write(addr, data);
 		} else if (addr < VRAM_END) {
-			vram[addr - VRAM_BEGIN] = data;
+			store(vram[addr - VRAM_BEGIN], addr, data);
+			if(video_write_log) [[unlikely]] video_write_log->record(addr, data);
 		} else if (addr < CARTRIDGE_RAM_END) {
-			cartridge.write(addr, data);
+			write_cartridge_ram(addr, data);
 		} else if (addr < WORK_RAM_END) {
-			wram[addr - WORK_RAM_BEGIN] = data;
+			store(wram[addr - WORK_RAM_BEGIN], addr, data);
 		} else if (addr < ECHO_RAM_END) {
-			wram[addr - ECHO_RAM_BEGIN] = data;
+			store(wram[addr - ECHO_RAM_BEGIN], static_cast<uint16_t>(addr - ECHO_RAM_BEGIN + WORK_RAM_BEGIN), data);
 		} else if (addr < OAM_END) {
-			oam[addr - OAM_BEGIN] = data;
+			store(oam[addr - OAM_BEGIN], addr, data);
+			if(video_write_log) [[unlikely]] video_write_log->record(addr, data);
 		} else if (addr < ILLEGAL_MEM_END) {
 			log_warn("Illegal memory write to {:#06x}", addr);
 			// TODO: doing nothing for now - if we have to implement reads revisit this
@@ -123,6 +137,7 @@ public:
 					}
 					return;
 				case DIVIDER:
+					apu.reset_div(cur_mclks * 4);
 					mem = 0;
 					return;
 				case TIMER_COUNTER: // TODO emulate weird timer behavior
@@ -132,34 +147,40 @@ public:
 					mem = data;
 					return;
 			} else if(addr < AUDIOS_END) {
+				apu.run_until(cur_mclks * 4);
 				apu.write(addr, data);
 				return;
-			} else if(addr < LCDS_END) switch(addr) {
-				// NOTE: only listing writable regs, anything else falls through
-				case LCD_CONTROL:
-					log_debug("LCDC {:08b}", data); // TODO remove
-					mem = data;
-					return;
-				case LCD_STATUS:
-					mem = mask_combine(0b0111'1000, mem, data);
-					return;
-				case LCD_SCROLL_Y:
-				case LCD_SCROLL_X:
-					mem = data;
-					return;
-				case LCD_CMP_Y:
-					mem = data;
-					return;
-				case OAM_DMA:
-					start_oam_dma(data);
-					return;
-				case BG_PALETTE_DATA:
-				case OBJ_PALETTE0_DATA:
-				case OBJ_PALETTE1_DATA:
-				case LCD_WINDOW_Y:
-				case LCD_WINDOW_X:
-					mem = data;
-					return;
+			} else if(addr < LCDS_END) {
+				if(video_write_log) [[unlikely]] video_write_log->record(addr, data);
+				// raster effects: anything the pixel pipeline reads, written while it's running.
+				if((get<LCD_STATUS>() & 3) == 3 && addr != LCD_STATUS && addr != LCD_CMP_Y && addr != OAM_DMA) ++mode3_lcd_writes;
+				switch(addr) {
+					// NOTE: only listing writable regs, anything else falls through
+					case LCD_CONTROL:
+						log_debug("LCDC {:08b}", data); // TODO remove
+						mem = data;
+						return;
+					case LCD_STATUS:
+						mem = mask_combine(0b0111'1000, mem, data);
+						return;
+					case LCD_SCROLL_Y:
+					case LCD_SCROLL_X:
+						mem = data;
+						return;
+					case LCD_CMP_Y:
+						mem = data;
+						return;
+					case OAM_DMA:
+						start_oam_dma(data);
+						return;
+					case BG_PALETTE_DATA:
+					case OBJ_PALETTE0_DATA:
+					case OBJ_PALETTE1_DATA:
+					case LCD_WINDOW_Y:
+					case LCD_WINDOW_X:
+						mem = data;
+						return;
+				}
 			} else {
 				if(addr == KEY0 || addr == KEY1) {
 					log_warn("Write to CGB address {:#x}", addr);
@@ -173,7 +194,7 @@ public:
 			}
 			throw_exc("Unimplemented: memory write to {:#x}", addr);
 		} else {
-			high_mem[addr - IO_MMAP_BEGIN] = data;
+			store(high_mem[addr - IO_MMAP_BEGIN], addr, data);
 		}
 	}
 
@@ -199,12 +220,29 @@ public:
 		return oam;
 	}
 
+	// OAM as the PPU sees it: all 0xFF while a DMA is using it.
+	const uint8_t* ppu_oam() const {
+		return oam_dma_active() ? BLOCKED_OAM.data() : oam.data();
+	}
+
+	bool oam_dma_active() const { return oam_dma_mclks_left && !oam_dma_delay; }
+
+	// when set, every CPU write to VRAM, OAM or the LCD registers is also recorded into log.
+	void set_video_write_log(WriteLog* log) { video_write_log = log; }
+
+	// when set, polled for new input whenever the CPU reads the joypad, see joypad::InputSource.
+	void set_input_source(joypad::InputSource* source) { input_source = source; }
+
+	// number of writes to LCD registers during mode 3 since the last call, see ppu::Renderer::AUTO.
+	unsigned take_mode3_lcd_writes() { return std::exchange(mode3_lcd_writes, 0); }
+
 	// request an interrupt
 	void request_interrupt(interrupt_bits i) { get<addrs::INTERRUPT_FLAG>() |= (1 << static_cast<uint8_t>(i)); }
 
 	void handle_timers(uint64_t old_mclks, uint64_t new_mclks) {
 		// TODO: this should just be a tick_mclk function.
 		using namespace addrs;
+		cur_mclks = new_mclks;
 		// DIV ticks up every 64 mclks.
 		get<DIVIDER>() += static_cast<uint8_t>((new_mclks / 64) - (old_mclks / 64));
 
@@ -222,6 +260,15 @@ public:
 			}
 		}
 
+		if(oam_dma_mclks_left) {
+			// NOTE: we only get here at the end of the instruction that started the transfer, so it can finish a couple mclks early (never late).
+			auto mclks = new_mclks - old_mclks;
+			const auto delay = std::min<uint64_t>(mclks, oam_dma_delay);
+			oam_dma_delay -= static_cast<uint8_t>(delay);
+			mclks -= delay;
+			oam_dma_mclks_left -= static_cast<uint8_t>(std::min<uint64_t>(mclks, oam_dma_mclks_left));
+		}
+
 		if(const auto timer_control = get<TIMER_CONTROL>(); timer_control & 0b100) { // timer enabled
 			const auto tima_mclks_shift = 2 + 2*((timer_control-1)&3);
 			auto& tima = get<TIMER_COUNTER>();
@@ -239,8 +286,91 @@ public:
 		serial_conn = conn;
 	}
 
+	// see gameboy_emulator::save_state(). what we're connected to (serial, input source, write log) isn't saved.
+	template<typename IO>
+	void save_state(IO& io) const { serialize(*this, io); }
+	void load_state(StateReader& io) { serialize(*this, io); }
+
+#if GB_STATE_HASH
+	// see gameboy_emulator::state_hash(). memory (VRAM, WRAM, OAM, HRAM + IE, cartridge RAM) is hashed as it's written,
+	// everything else goes through hash_registers().
+	uint64_t memory_hash() const {
+		if(tracked_memory_stale) {
+			using namespace addrs;
+			tracked_memory.clear();
+			tracked_memory.add(VRAM_BEGIN, vram);
+			tracked_memory.add(WORK_RAM_BEGIN, wram);
+			tracked_memory.add(OAM_BEGIN, oam);
+			tracked_memory.add(HRAM_BEGIN, std::span{high_mem}.subspan(HRAM_BEGIN - IO_MMAP_BEGIN));
+			tracked_memory.add(CARTRIDGE_RAM_LOCATION, cartridge.raw_ram());
+			tracked_memory_stale = false;
+		}
+		return tracked_memory.digest();
+	}
+
+	void hash_registers(StateHasher& hasher) const {
+		save_state(hasher); // skips the memory, see StateHasher
+		// the IO registers are changed from all over (timers, interrupts, the PPU), so they're hashed on the spot
+		for(const uint8_t reg : std::span{high_mem}.first(addrs::HRAM_BEGIN - addrs::IO_MMAP_BEGIN)) hasher(reg);
+	}
+#endif
+
+	// raw memory, for importing/exporting other save state formats (see bess.h).
+	// high_mem is the io regs, hram and IE from IO_MMAP_BEGIN, without the audio regs (those live in the APU).
+	std::span<uint8_t> raw_vram() { mark_memory_changed(); return vram; }
+	std::span<uint8_t> raw_wram() { mark_memory_changed(); return wram; }
+	std::span<uint8_t> raw_oam() { mark_memory_changed(); return oam; }
+	std::span<uint8_t> raw_high_mem() { mark_memory_changed(); return high_mem; }
+	std::span<const uint8_t> raw_vram() const { return vram; }
+	std::span<const uint8_t> raw_wram() const { return wram; }
+	std::span<const uint8_t> raw_oam() const { return oam; }
+	std::span<const uint8_t> raw_high_mem() const { return high_mem; }
+	Cartridge& get_cartridge() { mark_memory_changed(); return cartridge; }
+	const Cartridge& get_cartridge() const { return cartridge; }
+	std::span<const uint8_t> raw_boot_rom() const { return boot_rom; }
+	bool get_boot_rom_enabled() const { return boot_rom_enabled; }
+	void set_boot_rom_enabled(bool enabled) { boot_rom_enabled = enabled; }
+	// after writing memory from outside: no serial transfer or OAM DMA in progress.
+	void cancel_transfers() {
+		serial_bits_remaining = 0;
+		oam_dma_delay = 0;
+		oam_dma_mclks_left = 0;
+		mode3_lcd_writes = 0;
+	}
+
 private:
+	template<typename Self, typename IO>
+	static void serialize(Self& self, IO& io) {
+		io(self.cur_mclks);
+		io(self.boot_rom_enabled);
+		io.bytes(self.vram);
+		io.bytes(self.wram);
+		io.bytes(self.oam);
+		io.bytes(self.high_mem);
+		io(self.serial_shift_in);
+		io(self.serial_bits_remaining);
+		io(self.mode3_lcd_writes);
+		io(self.oam_dma_delay);
+		io(self.oam_dma_mclks_left);
+		if constexpr(std::is_const_v<Self>) self.cartridge.save_state(io);
+		else self.cartridge.load_state(io);
+#if GB_STATE_HASH
+		// memory_hash() comes along, so loading a state doesn't mean hashing all the memory again
+		if constexpr(!std::is_const_v<Self>) {
+			uint64_t digest;
+			io(digest);
+			self.tracked_memory = MultisetHash{digest};
+			self.tracked_memory_stale = false;
+		} else if constexpr(std::is_same_v<IO, StateWriter>) {
+			io(self.memory_hash());
+		} else {
+			io(uint64_t{}); // only its size matters here, and state_hash() adds it on its own
+		}
+#endif
+	}
+
 	apu::APU& apu;
+	uint64_t cur_mclks = 0; // as of the last handle_timers(), the start of the current instruction
 	Cartridge cartridge;
 	bool boot_rom_enabled{true};
 	const std::array<uint8_t, 256> boot_rom;
@@ -256,6 +386,60 @@ private:
 	constexpr static auto SERIAL_MCLKS_PER_BIT = 128; // TODO: not const for CGB
 
 	const joypad::Joypad& joypad;
+	joypad::InputSource* input_source = nullptr;
+
+	WriteLog* video_write_log = nullptr;
+	unsigned mode3_lcd_writes = 0;
+
+#if GB_STATE_HASH
+	// locations are addresses, except cartridge RAM, which goes by its offset into Cartridge::raw_ram() from here
+	constexpr static uint32_t CARTRIDGE_RAM_LOCATION = 0x1'0000;
+	mutable MultisetHash tracked_memory;
+	mutable bool tracked_memory_stale = true; // memory was changed from outside, hash it all again
+#endif
+
+	// a CPU write to memory tracked_memory covers, at location.
+	void store(uint8_t& mem, [[maybe_unused]] uint16_t location, uint8_t data) {
+#if GB_STATE_HASH
+		tracked_memory.update(location, mem, data);
+#endif
+		mem = data;
+	}
+
+	void write_cartridge_ram(uint16_t addr, uint8_t data) {
+#if GB_STATE_HASH
+		// RAM that's mapped in shows up in page() (see Mapper), anything else (disabled RAM, other registers) isn't tracked_memory's business.
+		const uint8_t* page = cartridge.page(addr & 0xFF00);
+		if(!page) {
+			cartridge.write(addr, data);
+			return;
+		}
+		const uint8_t& mem = page[addr & 0xFF];
+		const auto ram = std::as_const(cartridge).raw_ram();
+		const uint8_t old = mem;
+		cartridge.write(addr, data);
+		if(&mem >= ram.data() && &mem < ram.data() + ram.size()) tracked_memory.update(CARTRIDGE_RAM_LOCATION + static_cast<uint32_t>(&mem - ram.data()), old, mem);
+		else tracked_memory_stale = true;
+#else
+		cartridge.write(addr, data);
+#endif
+	}
+
+	void mark_memory_changed() {
+#if GB_STATE_HASH
+		tracked_memory_stale = true;
+#endif
+	}
+
+	// OAM DMA: 1 mclk of startup, then 1 byte per mclk.
+	constexpr static uint8_t OAM_DMA_MCLKS = 160;
+	uint8_t oam_dma_delay = 0;
+	uint8_t oam_dma_mclks_left = 0; // 0 when no transfer is in progress
+	constexpr static auto BLOCKED_OAM = []{
+		std::array<uint8_t, addrs::OAM_END - addrs::OAM_BEGIN> ret;
+		ret.fill(0xFF);
+		return ret;
+	}();
 
 	static std::array<uint8_t, 256> get_boot_rom(const std::span<const uint8_t> boot_rom_in) {
 		if(boot_rom_in.size() != 256) throw_exc("Boot rom has unexpected size {}", boot_rom_in.size());
@@ -264,15 +448,57 @@ private:
 		return ret;
 	}
 
+	// the page a DMA from the given source page actually reads, or nullptr if it has to go through the cartridge a byte at a time.
+	const uint8_t* oam_dma_source(const uint16_t src_addr) const {
+		using namespace addrs;
+		if(src_addr < CARTRIDGE_ROM_END) {
+			if(src_addr < BOOT_ROM_END && boot_rom_enabled) return boot_rom.data();
+			return cartridge.page(src_addr);
+		} else if (src_addr < VRAM_END) {
+			return &vram[src_addr - VRAM_BEGIN];
+		} else if (src_addr < CARTRIDGE_RAM_END) {
+			return cartridge.page(src_addr);
+		} else {
+			return &wram[(src_addr - WORK_RAM_BEGIN) & (wram.size() - 1)]; // anything above wram reads echo ram
+		}
+	}
+
+	// during OAM DMA, the CPU can't get at OAM (reads 0xFF) or at anything on the bus the DMA is reading from: the
+	// external bus (ROM, cartridge RAM, WRAM) or the video bus (VRAM). reads there get the byte the DMA is moving
+	// right now, writes are lost. the other bus, the IO registers and HRAM work as usual.
+	// what a blocked address reads as, or nullopt if it isn't blocked.
+	std::optional<uint8_t> oam_dma_conflict(const uint16_t addr) const {
+		using namespace addrs;
+		if(addr >= IO_MMAP_BEGIN) return std::nullopt;
+		if(addr >= OAM_BEGIN) return 0xFF;
+		const auto on_video_bus = [](uint16_t a) { return a >= VRAM_BEGIN && a < VRAM_END; };
+		if(on_video_bus(addr) != on_video_bus(static_cast<uint16_t>(get<OAM_DMA>() << 8))) return std::nullopt;
+		// OAM already has the whole transfer (see start_oam_dma()). the count only moves on between instructions,
+		// so this is the byte as of the start of the current one.
+		return oam[OAM_DMA_MCLKS - oam_dma_mclks_left];
+	}
+
 	void start_oam_dma(const uint8_t data) {
-		// TODO: oam is not instant.
 		get<addrs::OAM_DMA>() = data;
 		const uint16_t src_addr = data << 8;
-		log_debug("OAM DMA with source {:#06x}", src_addr);
-		auto cur_addr = src_addr;
-		for(uint8_t& oam_byte : oam) {
-			oam_byte = read(cur_addr);
-			cur_addr++;
+		// nothing can see OAM until the transfer is over (it reads as 0xFF), and the CPU can't write to the bus the
+		// transfer reads from, so copying it all up front is indistinguishable from copying a byte per mclk.
+		// this also covers restarting a transfer partway through, since the new one overwrites all of OAM anyway.
+#if GB_STATE_HASH
+		tracked_memory.remove(addrs::OAM_BEGIN, oam);
+#endif
+		if(const uint8_t* src = oam_dma_source(src_addr)) {
+			std::memcpy(oam.data(), src, oam.size());
+		} else {
+			for(uint16_t i = 0; i < oam.size(); ++i) oam[i] = cartridge.read(src_addr + i);
+		}
+#if GB_STATE_HASH
+		tracked_memory.add(addrs::OAM_BEGIN, oam);
+#endif
+		oam_dma_delay = 1;
+		oam_dma_mclks_left = OAM_DMA_MCLKS;
+		if(video_write_log) [[unlikely]] {
+			for(uint16_t i = 0; i < oam.size(); ++i) video_write_log->record(addrs::OAM_BEGIN + i, oam[i]);
 		}
 	}
 
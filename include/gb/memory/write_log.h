@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace gb::memory {
+
+// a log of CPU writes to some region of memory, timestamped by whoever owns the log.
+// the MMU records into it when one is attached, see MMU::set_video_write_log().
+struct WriteLog {
+	struct entry {
+		uint32_t time;
+		uint16_t addr;
+		uint8_t data;
+	};
+
+	uint32_t now = 0; // timestamp given to new entries, kept up to date by the owner
+	std::vector<entry> entries;
+
+	void record(uint16_t addr, uint8_t data) { entries.push_back({now, addr, data}); }
+};
+
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <gb/gb.h>
+#include <gb/joypad.h>
+#include <gb/utils/async_file_writer.h>
+#include <gb/utils/thread_pool.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace gb::movie {
+
+// input recordings ("movies"): the state the emulator started in, then every change to the buttons and exactly when it
+// happened, so playing one back from there goes through exactly the same frames.
+// a save state is embedded every keyframe_interval frames, with an index of them at the end of the file, so playback can
+// jump anywhere in a long recording by loading the nearest one before and running at most keyframe_interval frames.
+// the embedded states are our own (see gameboy_emulator::save_state()), so a movie only plays back on the build that
+// recorded it, and the ROM is checked too. the renderer asked for is kept as well (it's a setting, not in the states), as
+// the accurate one changes how long mode 3 takes; changing it while recording would desync playback.
+//
+// file layout, in this machine's byte order:
+//   header, start state
+//   records, in order: a change (kind, buttons, mclk) or a keyframe (KEYFRAME, then a state)
+//   index: a keyframe_entry per keyframe
+//   footer
+
+// when button changes are picked up.
+enum class Granularity : uint8_t {
+	FRAME, // only at the start of each frame
+	JOYPAD_READ, // also whenever the game reads the joypad, see joypad::InputSource
+};
+
+// bitmask of pressed buttons, bit i for joypad_bits i, see gameboy_emulator::held_buttons().
+using Buttons = uint8_t;
+
+constexpr unsigned DEFAULT_KEYFRAME_INTERVAL = 120; // 2 seconds
+
+// records the emulator's input while it runs. input still comes from the UI (live), which presses and releases buttons
+// as usual: the recorder takes over as the emulator's input source and passes polls on to live.
+class Recorder : joypad::InputSource {
+public:
+	Recorder(gameboy_emulator& emulator, const std::filesystem::path& path, joypad::InputSource* live, Granularity granularity, unsigned keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+	~Recorder() override; // calls finish(), but swallows errors
+	Recorder(const Recorder&) = delete;
+	Recorder& operator=(const Recorder&) = delete;
+
+	// call right before each gameboy_emulator::run_frame(), after the UI has applied its input for the frame.
+	void frame_start();
+
+	// write the index and close the file, and give the input source back to live. throws if writing failed.
+	void finish();
+
+	uint64_t frames() const { return frame_count; }
+
+private:
+	void poll(uint64_t mclk) override;
+	void record_changes(uint8_t kind, uint64_t mclk);
+
+	gameboy_emulator& emulator;
+	joypad::InputSource* live;
+	Granularity granularity;
+	unsigned keyframe_interval;
+	AsyncFileWriter file;
+	std::vector<uint8_t> scratch;
+	std::vector<uint8_t> index;
+	Buttons last_buttons;
+	uint64_t frame_count = 0;
+	uint64_t change_count = 0;
+	uint64_t keyframe_count = 0;
+	bool finished = false;
+};
+
+// a recording, read from its file (which has to outlive it). only the small parts are copied out, the states stay in file.
+// throws if it's cut off or otherwise broken.
+class Movie {
+public:
+	explicit Movie(std::span<const uint8_t> file);
+
+	uint64_t frames() const { return frame_count; }
+
+	// frames (after the start state) with a state saved right after them, in order.
+	std::vector<uint64_t> keyframe_frames() const;
+
+private:
+	friend class Player;
+
+	struct change {
+		uint64_t mclk;
+		uint8_t kind;
+		Buttons buttons;
+	};
+
+	struct keyframe {
+		uint64_t frame;
+		uint64_t change_index; // first change after it
+		std::span<const uint8_t> state;
+	};
+
+	uint64_t rom_hash;
+	ppu::Renderer renderer;
+	std::span<const uint8_t> start_state;
+	std::vector<change> changes;
+	std::vector<keyframe> keyframes;
+	uint64_t frame_count = 0;
+};
+
+// plays a recording back: becomes the emulator's input source and presses and releases buttons just as they were.
+// movie has to outlive the player. any number of players can share one movie.
+class Player : joypad::InputSource {
+public:
+	// loads the start state and asks for the renderer it was recorded with. throws if the movie is for another ROM or build.
+	Player(gameboy_emulator& emulator, const Movie& movie);
+	~Player() override;
+	Player(const Player&) = delete;
+	Player& operator=(const Player&) = delete;
+
+	uint64_t frames() const { return movie.frames(); }
+	uint64_t frame() const { return cur_frame; } // frames run since the start state
+	bool done() const { return cur_frame >= movie.frames(); }
+
+	// run the next frame with its recorded input. past the end, the buttons stay as they were.
+	void run_frame();
+
+	// get to the point after frame frames: load the nearest keyframe before (unless carrying on from here is closer)
+	// and run the rest without drawing (except the last) or sound.
+	void seek(uint64_t frame);
+
+private:
+	void poll(uint64_t mclk) override;
+	void load(std::span<const uint8_t> state, uint64_t frame, uint64_t change_index);
+
+	gameboy_emulator& emulator;
+	const Movie& movie;
+	uint64_t cur_frame = 0;
+	size_t next_change = 0;
+};
+
+// makes a fresh emulator for the movie's ROM. called from the pool's threads, possibly several at once.
+using EmulatorFactory = std::function<std::unique_ptr<gameboy_emulator>()>;
+// gets every frame of a movie, in order. frame is how many frames had run when it was shown, from 1 to movie.frames().
+using FrameSink = std::function<void(uint64_t frame, const ppu::Frame&)>;
+
+// play the whole movie back without sound and hand every frame to sink, on this thread.
+// the stretches between keyframes are independent, so each is replayed from its keyframe on its own emulator, spread
+// over pool. sink gets them in order as they're done; only a couple of stretches per thread are run ahead of it.
+void render(const Movie& movie, const EmulatorFactory& make_emulator, const FrameSink& sink, ThreadPool& pool = ThreadPool::shared());
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <gb/gb.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace gb {
+
+// save states for when there are lots of them (search archives, rewind histories of many emulators at once).
+// the memory in a state (VRAM, WRAM, OAM, HRAM, cartridge RAM and the picture, see StateLayout) is split into 256 byte
+// pages, and a page is stored once however many states have it, with a count of the states using it. most pages are
+// the same across states of one game, so a state comes down to its registers (a few hundred bytes) and a table of page ids.
+// safe to use from several threads. all states in a store are of one game on one build.
+class PageStore {
+public:
+	constexpr static size_t PAGE_SIZE = 256;
+	using PageId = uint32_t;
+
+	// a state in a store, giving its pages back when it goes. the store has to outlive it.
+	class Snapshot {
+	public:
+		Snapshot() = default;
+		Snapshot(Snapshot&& other) noexcept { *this = std::move(other); }
+		Snapshot& operator=(Snapshot&& other) noexcept;
+		~Snapshot() { reset(); }
+
+		void reset();
+		bool empty() const { return !store; }
+		// not counting the pages
+		size_t bytes() const { return registers.capacity() + pages.capacity() * sizeof(PageId); }
+
+	private:
+		friend class PageStore;
+		PageStore* store = nullptr;
+		std::vector<uint8_t> registers; // everything but the memory, back to back
+		std::vector<PageId> pages;
+	};
+
+	struct stats {
+		size_t snapshots = 0;
+		size_t page_refs = 0; // pages in all the snapshots
+		size_t unique_pages = 0; // pages stored
+		size_t bytes = 0; // stored pages, and the index to them
+
+		// how many times over the pages would take up stored separately
+		double dedup_ratio() const { return unique_pages ? static_cast<double>(page_refs) / static_cast<double>(unique_pages) : 1.0; }
+	};
+
+	PageStore() = default;
+	PageStore(const PageStore&) = delete;
+	PageStore& operator=(const PageStore&) = delete;
+	~PageStore();
+
+	Snapshot save(gameboy_emulator& emulator);
+	// the save state the snapshot was made from, see gameboy_emulator::save_state().
+	void restore(const Snapshot& snapshot, std::span<uint8_t> out) const;
+	void load(const Snapshot& snapshot, gameboy_emulator& emulator) const;
+
+	size_t state_size() const;
+	stats get_stats() const;
+
+private:
+	struct page {
+		std::array<uint8_t, PAGE_SIZE> data;
+		uint64_t hash;
+		uint32_t refs; // 0 when free
+	};
+
+	// the id of a page with these contents, adding it if there isn't one yet. with the lock held.
+	PageId intern(const std::array<uint8_t, PAGE_SIZE>& data, uint64_t hash);
+	void release(std::span<const PageId> ids);
+
+	mutable std::mutex lock;
+	StateLayout layout; // of the first state saved, the rest have to match
+	std::vector<page> pages;
+	std::vector<PageId> free_ids;
+	std::unordered_multimap<uint64_t, PageId> index; // by hash of the contents
+	size_t snapshots = 0;
+	size_t page_refs = 0;
+};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <gb/consts.h>
+#include <gb/memory/memory_map.h>
 
 #include <array>
 #include <cstdint>
@@ -8,6 +9,7 @@
 namespace gb::ppu {
 
 constexpr unsigned MODE2_TCLKS = 80;
+constexpr unsigned MODE3_MIN_TCLKS = 172; // with SCX % 8 == 0, no window and no objects
 
 constexpr unsigned TILE_SZ = 8;
 
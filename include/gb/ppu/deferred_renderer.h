@@ -0,0 +1,74 @@
+#pragma once
+
+#include "consts.h"
+#include "line_renderer.h"
+#include "scanline_renderer.h"
+#include <gb/memory/memory_map.h>
+#include <gb/memory/write_log.h>
+#include <gb/utils/thread_pool.h>
+
+#include <array>
+#include <cstdint>
+
+namespace gb::ppu {
+
+enum class RenderMode : uint8_t {
+	INLINE, // draw each line as the PPU reaches it
+	DEFERRED, // record video memory writes, then render all lines in parallel when vblank starts
+	PIPELINED, // like DEFERRED, but let rendering run in the background until the frame is read
+};
+
+// Renders frames from a snapshot of video memory taken at the start of the frame,
+// plus a log of every write to video memory during the frame (stamped with the first line it can show up on).
+// Lines are split into chunks, and each chunk replays the log on its own copy of video memory,
+// so the output matches the inline ScanlineRenderer exactly.
+// Only the ScanlineRenderer is deferred: it draws a whole line as mode 3 starts, so the log only needs line granularity.
+// Mid-line raster effects need the FifoRenderer, which always draws inline.
+class DeferredRenderer {
+public:
+	explicit DeferredRenderer(ThreadPool& pool = ThreadPool::shared()) : pool{pool} {}
+	~DeferredRenderer() { wait(); }
+
+	// snapshot video memory and start logging writes for a new frame.
+	void begin_frame(const VideoMemoryView& mem);
+
+	memory::WriteLog& write_log() { return recording().log; }
+	LineSetup& line_setup(uint8_t ly) { return recording().lines[ly]; }
+
+	// render the recorded frame into out. out must stay alive until wait() returns.
+	void submit(Frame& out);
+
+	// block until the last submitted frame is fully rendered.
+	void wait() { pool.wait(in_flight); }
+
+	// log timestamp for writes made once the PPU is line_clks into line ly: the next line to be drawn.
+	static constexpr uint32_t next_line(unsigned ly, unsigned line_clks) { return line_clks < MODE2_TCLKS ? ly : ly + 1; }
+
+private:
+	struct video_memory {
+		std::array<uint8_t, memory::addrs::VRAM_END - memory::addrs::VRAM_BEGIN> vram;
+		std::array<uint8_t, memory::addrs::OAM_END - memory::addrs::OAM_BEGIN> oam;
+		std::array<uint8_t, memory::addrs::LCDS_END - memory::addrs::LCDS_BEGIN> lcd_regs;
+
+		VideoMemoryView view() const { return {vram.data(), oam.data(), lcd_regs.data()}; }
+		void apply(const memory::WriteLog::entry& write);
+	};
+
+	struct frame_job {
+		video_memory snapshot;
+		memory::WriteLog log;
+		std::array<LineSetup, LCD_HEIGHT> lines;
+	};
+
+	static void render_lines(const frame_job& job, Frame& out, unsigned first_line, unsigned end_line);
+
+	// one job is filled in by the PPU while the other is owned by the workers until in_flight finishes.
+	frame_job& recording() { return jobs[recording_idx]; }
+
+	ThreadPool& pool;
+	TaskGroup in_flight;
+	std::array<frame_job, 2> jobs;
+	unsigned recording_idx = 0;
+};
+
+}
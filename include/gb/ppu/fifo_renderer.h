@@ -0,0 +1,167 @@
+#pragma once
+
+#include "consts.h"
+#include "line_renderer.h"
+#include <gb/utils/state_io.h>
+
+#include <array>
+
+namespace gb::ppu {
+
+// dot by dot model of the DMG pixel pipeline: a background/window fetcher feeding an 8 pixel fifo,
+// plus an object fifo filled by object fetches that stall the pipeline.
+// registers are read at the dot the hardware reads them, so mid-line writes (raster effects) show up where they should,
+// and mode 3 length varies the same way it does on hardware:
+// 172 dots, plus SCX % 8, plus 6 for the window, plus 6-11 for each object.
+// TODO: window glitches (WX changes, window disabled and re-enabled mid-line), LCDC.1 toggled mid-line.
+class FifoRenderer {
+public:
+	void begin_line(const LineSetup& setup_in, const VideoMemoryView& mem, Line* out_in) {
+		setup = setup_in;
+		out = out_in;
+		lcd_x = 0;
+		discard = mem.reg<memory::addrs::LCD_SCROLL_X>() & 7;
+		bg_count = 0;
+		obj_fifo = {};
+		obj_fifo_head = 0;
+		obj_stall = 0;
+		fetch_dots = 0;
+		fetch_col = 0;
+		dummy_fetch = true;
+		fetching_window = false;
+	}
+
+	bool tick(const VideoMemoryView& mem) {
+		const auto LCDC = mem.reg<memory::addrs::LCD_CONTROL>();
+		if(!obj_stall && bg_count && !discard) {
+			if(!fetching_window && window_covers(LCDC, mem.reg<memory::addrs::LCD_WINDOW_X>(), lcd_x, setup.wy_cond_triggered)) {
+				start_window(mem.reg<memory::addrs::LCD_WINDOW_X>());
+			} else if(setup.num_objects && setup.objects[setup.num_objects - 1].x_plus_8 <= lcd_x + 8) {
+				// the object fetch has to wait for the background fetch to (nearly) finish.
+				// the last dot of the background fetch overlaps with the object fetch.
+				obj_stall = OBJ_FETCH_TCLKS + (fetch_dots < FETCH_TCLKS - 1 ? FETCH_TCLKS - 1 - fetch_dots : 0);
+			}
+		}
+
+		if(obj_stall) {
+			step_fetcher(mem, LCDC);
+			if(--obj_stall == 0) load_obj(mem, LCDC);
+			return false;
+		}
+
+		if(bg_count) {
+			const uint8_t bg_color = static_cast<uint8_t>(((bg_hi >> 6) & 2) | (bg_lo >> 7));
+			bg_lo <<= 1;
+			bg_hi <<= 1;
+			--bg_count;
+			if(discard) {
+				--discard;
+			} else {
+				auto& obj = obj_fifo[obj_fifo_head++ & 7];
+				if(out) (*out)[lcd_x] = mix_pixel(bg_color, obj, LCDC, mem);
+				obj = {};
+				++lcd_x;
+			}
+		}
+		step_fetcher(mem, LCDC);
+		if(lcd_x != LCD_WIDTH) return false;
+		out = nullptr; // done with the line, so a save state after this doesn't point at it
+		return true;
+	}
+
+	bool window_drawn() const { return fetching_window; }
+
+	// for save states. out is saved as whether there was one, line is what it should point to after loading.
+	template<typename IO>
+	void save_state(IO& io) const {
+		serialize(*this, io);
+		io(static_cast<bool>(out));
+	}
+	void load_state(StateReader& io, Line* line) {
+		serialize(*this, io);
+		bool has_out;
+		io(has_out);
+		out = has_out ? line : nullptr;
+	}
+
+private:
+	template<typename Self, typename IO>
+	static void serialize(Self& self, IO& io) {
+		io(self.setup); io(self.lcd_x); io(self.discard);
+		io(self.bg_lo); io(self.bg_hi); io(self.bg_count);
+		io(self.obj_fifo); io(self.obj_fifo_head); io(self.obj_stall);
+		io(self.fetch_dots); io(self.fetch_col); io(self.fetched_tile); io(self.fetched_lo); io(self.fetched_hi);
+		io(self.dummy_fetch); io(self.fetching_window);
+	}
+
+	constexpr static uint8_t FETCH_TCLKS = 6; // 2 dots each for tile index, low byte, high byte
+	constexpr static uint8_t OBJ_FETCH_TCLKS = 6;
+
+	void start_window(uint8_t WX) {
+		fetching_window = true;
+		bg_count = 0;
+		fetch_dots = 0;
+		fetch_col = 0;
+		if(WX < 7) discard = static_cast<uint8_t>(7 - WX); // only possible at x = 0
+	}
+
+	void step_fetcher(const VideoMemoryView& mem, uint8_t LCDC) {
+		using namespace memory::addrs;
+		if(fetch_dots < FETCH_TCLKS) {
+			++fetch_dots;
+			const uint8_t y = fetching_window ? setup.window_y_counter : static_cast<uint8_t>(mem.reg<LCD_SCROLL_Y>() + setup.ly);
+			if(fetch_dots == 2) {
+				const unsigned col = fetching_window ? fetch_col : (mem.reg<LCD_SCROLL_X>() >> 3) + fetch_col;
+				const bool tile_map = get_bit(LCDC, fetching_window ? 6 : 3);
+				fetched_tile = mem.vram[0x1800 + (tile_map * 0x400) + ((y >> 3) << 5) + (col & 31)];
+			} else if(fetch_dots == 4 || fetch_dots == 6) {
+				const uint16_t tile_idx = fetched_tile + (((~LCDC & 0b1'0000) << 4) & ((~fetched_tile & 0x80) << 1)); // add 256 if ~LCDC.4 and tile_idx >= 0;
+				const uint8_t data = mem.vram[(((tile_idx * TILE_SZ) + (y & 7)) * 2) + (fetch_dots == 6)];
+				(fetch_dots == 4 ? fetched_lo : fetched_hi) = data;
+			}
+		}
+		// push once the fifo is empty
+		if(fetch_dots == FETCH_TCLKS && bg_count == 0) {
+			fetch_dots = 0;
+			if(dummy_fetch) { // the first tile of a line is fetched twice
+				dummy_fetch = false;
+				return;
+			}
+			bg_lo = fetched_lo;
+			bg_hi = fetched_hi;
+			bg_count = 8;
+			++fetch_col;
+		}
+	}
+
+	void load_obj(const VideoMemoryView& mem, uint8_t LCDC) {
+		const auto& obj = setup.objects[--setup.num_objects];
+		const auto row = fetch_obj_row(obj, LCDC, mem);
+		// objects partially off the left of the screen are fetched at x = 0 with their offscreen pixels dropped.
+		const unsigned shift = lcd_x + 8 - obj.x_plus_8;
+		for(unsigned i = shift; i < 8; ++i) {
+			auto& px = obj_fifo[(obj_fifo_head + i - shift) & 7];
+			if(px.color == TRANSPARENT) px = row.pixel(i);
+		}
+	}
+
+	LineSetup setup;
+	Line* out = nullptr;
+	uint8_t lcd_x = 0; // next pixel to be pushed to the LCD
+	uint8_t discard = 0; // pixels left to throw away instead of pushing to the LCD
+
+	// background/window fifo, as 2 bitplanes with the next pixel in bit 7
+	uint8_t bg_lo = 0, bg_hi = 0, bg_count = 0;
+	std::array<obj_px, 8> obj_fifo{};
+	uint8_t obj_fifo_head = 0;
+	uint8_t obj_stall = 0; // dots left in the current object fetch
+
+	uint8_t fetch_dots = 0; // progress of the background fetcher, FETCH_TCLKS when its tile is ready to push
+	uint8_t fetch_col = 0; // tiles pushed since the start of the line or window
+	uint8_t fetched_tile = 0, fetched_lo = 0, fetched_hi = 0;
+	bool dummy_fetch = true;
+	bool fetching_window = false;
+};
+static_assert(LineRenderer<FifoRenderer>);
+
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "consts.h"
+#include <gb/memory/memory_map.h>
+#include <gb/utils/bitops.h>
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+
+namespace gb::ppu {
+
+// the memory the pixel pipeline reads: either the MMU itself, or a copy of it (see DeferredRenderer).
+struct VideoMemoryView {
+	const uint8_t* vram; // VRAM_BEGIN - VRAM_END
+	const uint8_t* oam; // OAM_BEGIN - OAM_END
+	const uint8_t* lcd_regs; // LCDS_BEGIN - LCDS_END
+
+	template<uint16_t Addr>
+	[[nodiscard]] uint8_t reg() const {
+		static_assert(Addr >= memory::addrs::LCDS_BEGIN && Addr < memory::addrs::LCDS_END);
+		return lcd_regs[Addr - memory::addrs::LCDS_BEGIN];
+	}
+
+	[[nodiscard]] oam_entry oam_at(uint8_t idx) const {
+		oam_entry ret;
+		std::memcpy(&ret, oam + idx * sizeof(oam_entry), sizeof(ret));
+		return ret;
+	}
+};
+
+// TODO - would need testing on real hardware
+struct scanned_object {
+	uint8_t idx;
+	uint8_t x_plus_8;
+	uint8_t row_ignoring_flip;
+};
+
+// everything needed to draw a line that doesn't live in video memory.
+// fixed when the PPU enters mode 3.
+struct LineSetup {
+	std::array<scanned_object, 10> objects; // sorted in reverse priority so we can pop from back
+	uint8_t num_objects = 0;
+	uint8_t ly = 0;
+	uint8_t window_y_counter = 0;
+	bool wy_cond_triggered = false;
+
+	// simulate OAM scan. TODO handle DMA during mode 2?
+	void scan_oam(const VideoMemoryView& mem) {
+		const auto LCDC = mem.reg<memory::addrs::LCD_CONTROL>();
+		const int obj_height = TILE_SZ + ((LCDC & 0b100) << 1);
+		num_objects = 0;
+		if(get_bit(LCDC, 1)) { // TODO: when does LCDC.1 actually have effects?
+			for(uint8_t idx = 0; idx < NUM_OAM_ENTRIES; ++idx) {
+				const auto oam_entry = mem.oam_at(idx);
+				const auto sprite_row = ly - (oam_entry.y_plus_16 - 16);
+				if(sprite_row < 0 || sprite_row >= obj_height) continue;
+				objects[num_objects] = {
+					.idx = idx,
+					.x_plus_8 = oam_entry.x_plus_8,
+					.row_ignoring_flip = static_cast<uint8_t>(sprite_row),
+				};
+				++num_objects;
+				if(num_objects == objects.size()) break;
+			}
+		}
+		std::sort(objects.begin(), objects.begin()+num_objects, [](scanned_object a, scanned_object b){
+			if(a.x_plus_8 == b.x_plus_8) return a.idx > b.idx;
+			return a.x_plus_8 > b.x_plus_8;
+		});
+	}
+};
+
+// whether pixel cur_x comes from the window rather than the background.
+[[nodiscard]] constexpr bool window_covers(uint8_t LCDC, uint8_t WX, unsigned cur_x, bool wy_cond_triggered) {
+	const bool enable_bg_window = LCDC & 1;
+	const int window_x = static_cast<int>(cur_x) + 7 - static_cast<int>(WX);
+	return enable_bg_window && get_bit(LCDC, 5) && window_x >= 0 && wy_cond_triggered;
+}
+
+[[nodiscard]] constexpr uint8_t palette_color(uint8_t palette, uint8_t color) {
+	return static_cast<uint8_t>((palette >> (2 * color)) & 3);
+}
+
+// a pixel of an object, as it sits in the object fifo.
+struct obj_px {
+	uint8_t color : 2 = TRANSPARENT;
+	uint8_t palette: 1;
+	bool low_prio: 1;
+	// NOTE: on DMG only color is considered, on CGB we should also default to lower than lowest prio here.
+};
+
+// the row of an object's tile on the current line, with x flip already applied (leftmost pixel in bit 7).
+struct obj_row {
+	uint8_t lo;
+	uint8_t hi;
+	bool palette;
+	bool low_prio;
+
+	[[nodiscard]] obj_px pixel(unsigned i) const {
+		return {
+			.color = static_cast<uint8_t>((((hi << i) >> 6) & 2) | (((lo << i) >> 7) & 1)),
+			.palette = palette,
+			.low_prio = low_prio,
+		};
+	}
+};
+
+[[nodiscard]] inline obj_row fetch_obj_row(const scanned_object& scanned_obj, uint8_t LCDC, const VideoMemoryView& mem) {
+	const oam_entry obj = mem.oam_at(scanned_obj.idx);
+	const int obj_height = TILE_SZ + ((LCDC & 0b100) << 1);
+	auto y = scanned_obj.row_ignoring_flip;
+	if(get_bit(obj.flags, 6)) { // y flip
+		y ^= (obj_height - 1);
+	}
+	const auto base_tile_idx = obj.tile_idx & ~((LCDC >> 2) & 1); // if LCDC 1, zero last bit of idx
+	// TODO: what happens if we have change to using short objects in the middle of a frame and read past end?
+	const auto tiledata = mem.vram + 2*(TILE_SZ*base_tile_idx + y);
+	obj_row ret{
+		.lo = tiledata[0],
+		.hi = tiledata[1],
+		.palette = get_bit(obj.flags, 4),
+		.low_prio = get_bit(obj.flags, 7),
+	};
+	if(get_bit(obj.flags, 5)) { // x flip
+		constexpr static auto reverse = [](uint8_t b) {
+			b = static_cast<uint8_t>((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+			b = static_cast<uint8_t>((b & 0xCC) >> 2 | (b & 0x33) << 2);
+			return static_cast<uint8_t>((b & 0xAA) >> 1 | (b & 0x55) << 1);
+		};
+		ret.lo = reverse(ret.lo);
+		ret.hi = reverse(ret.hi);
+	}
+	return ret;
+}
+
+// the final color of a pixel, given the background/window color index (before palette) and the object pixel.
+[[nodiscard]] inline Gray mix_pixel(uint8_t bg_color, obj_px obj, uint8_t LCDC, const VideoMemoryView& mem) {
+	// if sprite opaque and not low prio, use that.
+	// elif background color 1-3, use that.
+	// elif sprite opaque and low prio, use that.
+	// else render background color 0 if bg_enabled, or white otherwise.
+	// TODO: mixing here
+	if(!(LCDC & 1)) bg_color = 0; // bg/window disabled, objects always on top
+	if(obj.color && (!obj.low_prio || (bg_color == 0))) {
+		const auto obj_palette = obj.palette ? mem.reg<memory::addrs::OBJ_PALETTE1_DATA>() : mem.reg<memory::addrs::OBJ_PALETTE0_DATA>();
+		return {palette_color(obj_palette, obj.color)};
+	}
+	if(!(LCDC & 1)) return {0}; // white
+	return {palette_color(mem.reg<memory::addrs::BG_PALETTE_DATA>(), bg_color)};
+}
+
+// which renderer draws mode 3.
+enum class Renderer : uint8_t {
+	FAST, // ScanlineRenderer: whole line at once, fixed length mode 3
+	ACCURATE, // FifoRenderer: pixel fifo, mid-line register writes and variable length mode 3
+	AUTO, // FAST, switching to ACCURATE while the game writes LCD registers during mode 3
+};
+
+// what the PPU needs from a renderer:
+// begin_line() when mode 3 starts, then tick() once per dot until it returns true, which ends mode 3.
+// out may be null, in which case only the timing is emulated (the line gets drawn somewhere else, or not at all).
+template<typename T>
+concept LineRenderer = requires(T renderer, const LineSetup& setup, const VideoMemoryView& mem, Line* out) {
+	renderer.begin_line(setup, mem, out);
+	{ renderer.tick(mem) } -> std::same_as<bool>;
+	{ renderer.window_drawn() } -> std::same_as<bool>; // whether the window showed up on the line, valid once tick() returns true
+};
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "consts.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace gb::ppu {
+
+// Downscaled, cropped grayscale views of the LCD, e.g. 84x84 frames for learning agents.
+// output pixels are one byte each, 0 is black and 255 is white (so Gray 0 -> 255, Gray 3 -> 0).
+struct ObservationConfig {
+	enum class Filter : uint8_t {
+		NEAREST, // sample the source pixel nearest to the center of each output pixel
+		BOX, // average all source pixels covered by each output pixel
+	};
+
+	// region of interest in LCD pixels
+	unsigned crop_x = 0;
+	unsigned crop_y = 0;
+	unsigned crop_width = LCD_WIDTH;
+	unsigned crop_height = LCD_HEIGHT;
+
+	// output size, at most crop_width x crop_height.
+	unsigned width = 84;
+	unsigned height = 84;
+	Filter filter = Filter::BOX;
+
+	// number of most recent observations kept in the output buffer, 1 to disable stacking.
+	unsigned stack_size = 1;
+};
+
+// writes observations into caller-owned memory, never allocates.
+// the output buffer is a ring of stack_size planes of width x height bytes;
+// each write() fills the plane after the previous one, see plane() for finding a given frame.
+class Observer {
+public:
+	explicit Observer(const ObservationConfig& config);
+
+	size_t plane_bytes() const { return static_cast<size_t>(config.width) * config.height; }
+	size_t buffer_bytes() const { return plane_bytes() * config.stack_size; }
+	const ObservationConfig& get_config() const { return config; }
+
+	// @param out must be at least buffer_bytes() long, and the same buffer every call when stacking.
+	void write(const Frame& frame, std::span<uint8_t> out);
+
+	// index of the plane holding the observation from `age` writes ago (0 = newest).
+	// only meaningful for age < min(stack_size, writes so far).
+	unsigned plane(unsigned age = 0) const {
+		return static_cast<unsigned>((writes + config.stack_size - 1 - (age % config.stack_size)) % config.stack_size);
+	}
+
+	// start a new episode: the next write goes to plane 0.
+	void reset() { writes = 0; }
+
+private:
+	void write_nearest(const Frame& frame, uint8_t* out) const;
+	void write_box(const Frame& frame, uint8_t* out) const;
+
+	ObservationConfig config;
+	uint64_t writes = 0;
+
+	// source pixel boundaries for each output pixel: output column i covers [col_begin[i], col_begin[i+1]).
+	// for NEAREST, col_begin[i] is the sampled column.
+	std::array<uint8_t, LCD_WIDTH + 1> col_begin{};
+	std::array<uint8_t, LCD_HEIGHT + 1> row_begin{};
+};
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "consts.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace gb::ppu {
+
+// Frame stores one byte per pixel, but a DMG pixel only has 2 bits of information.
+// PackedFrame stores 4 pixels per byte, leftmost pixel in the lowest 2 bits.
+constexpr size_t PACKED_LINE_BYTES = LCD_WIDTH / 4;
+using PackedLine = std::array<uint8_t, PACKED_LINE_BYTES>;
+using PackedFrame = std::array<PackedLine, LCD_HEIGHT>;
+static_assert(sizeof(PackedFrame) == 5'760);
+static_assert(sizeof(Frame) == LCD_WIDTH * LCD_HEIGHT, "Frame is expected to be one contiguous byte per pixel");
+
+constexpr size_t FRAME_PIXELS = LCD_WIDTH * LCD_HEIGHT;
+
+// RGBA8888, laid out in memory as R, G, B, A (so R is the lowest byte on little endian).
+constexpr uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 0xFF) {
+	return r | (g << 8) | (b << 16) | (static_cast<uint32_t>(a) << 24);
+}
+
+// indexed by Gray::raw, 0 is lightest.
+using RGBAPalette = std::array<uint32_t, 4>;
+constexpr RGBAPalette GRAYSCALE_PALETTE{
+	rgba(0xFF, 0xFF, 0xFF), rgba(0xAA, 0xAA, 0xAA), rgba(0x55, 0x55, 0x55), rgba(0x00, 0x00, 0x00)
+};
+
+using RGBAFrame = std::span<uint32_t, FRAME_PIXELS>;
+using ConstRGBAFrame = std::span<const uint32_t, FRAME_PIXELS>;
+
+// conversions between pixel formats. SIMD where available.
+void pack(const Frame& in, PackedFrame& out);
+void unpack(const PackedFrame& in, Frame& out);
+void unpack_rgba(const PackedFrame& in, RGBAFrame out, const RGBAPalette& palette = GRAYSCALE_PALETTE);
+// colors not in the palette are packed as 0.
+void pack_rgba(ConstRGBAFrame in, PackedFrame& out, const RGBAPalette& palette = GRAYSCALE_PALETTE);
+void to_rgba(const Frame& in, RGBAFrame out, const RGBAPalette& palette = GRAYSCALE_PALETTE);
+
+// output formats for exporting frames out of the emulator.
+enum class FrameFormat : uint8_t {
+	GRAY8 = 0, // same as Frame, one Gray per byte
+	PACKED_2BPP = 1, // same as PackedFrame
+	RGBA8888 = 2, // GRAYSCALE_PALETTE
+};
+
+constexpr size_t frame_bytes(FrameFormat format) {
+	switch(format) {
+		case FrameFormat::GRAY8: return sizeof(Frame);
+		case FrameFormat::PACKED_2BPP: return sizeof(PackedFrame);
+		case FrameFormat::RGBA8888: return FRAME_PIXELS * sizeof(uint32_t);
+	}
+	return 0;
+}
+
+// write a frame into out, which must be exactly frame_bytes(format) long.
+void export_frame(const Frame& in, FrameFormat format, std::span<uint8_t> out);
+
+}
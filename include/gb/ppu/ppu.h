@@ -1,8 +1,15 @@
 #pragma once
 
 #include "consts.h"
+#include "deferred_renderer.h"
+#include "fifo_renderer.h"
+#include "line_renderer.h"
+#include "packed_frame.h"
+#include "scanline_renderer.h"
 #include <gb/memory/mmu.h>
 
+#include <limits>
+#include <memory>
 #include <span>
 #include <sstream>
 
@@ -13,7 +20,25 @@ struct PPU {
 		reset();
 	}
 
-	const Frame& cur_frame() const { return frame; }
+	~PPU() {
+		mmu.set_video_write_log(nullptr);
+	}
+
+	const Frame& cur_frame() const {
+		if(deferred) deferred->wait();
+		return frame;
+	}
+
+	// these take effect at the start of the next frame.
+	// the deferred render modes only apply to the fast renderer, frames drawn by the accurate renderer are always drawn inline.
+	void set_render_mode(RenderMode mode) { requested_render_mode = mode; }
+	void set_renderer(Renderer r) { requested_renderer = r; }
+	// skip drawing frames nobody will see (e.g. fast-forward). timing is still emulated exactly, only the pixels are skipped,
+	// so the emulation doesn't change. cur_frame() keeps the last frame that was drawn.
+	void set_frame_skip(bool skip) { skip_frames = skip; }
+	RenderMode render_mode_in_use() const { return render_mode; }
+	Renderer renderer_in_use() const { return renderer; } // never AUTO
+	Renderer renderer_requested() const { return requested_renderer; }
 
 	void reset() {
 		log_debug("resetting PPU");
@@ -22,6 +47,7 @@ struct PPU {
 		// TODO: the real starting state should be on line 0
 		was_last_off = true;
 		stat_interrupt_wanted = false;
+		if(deferred) deferred->wait();
 		frame = {};
 		lcd_status() = 0b1000'0000 | static_cast<uint8_t>(Mode::VBLANK);
 		lcd_cur_y() = (VBLANK_LINES + LCD_HEIGHT) - 1;
@@ -46,57 +72,7 @@ struct PPU {
 		const auto EOL = line_clks == LINE_TCLKS - 1;
 
 		if(cur_mode == Mode::DRAW) {
-			// For now, rough approximation of PPU behavior.
-			// will flesh out later.
-			if(const unsigned cur_x = line_clks - MODE2_TCLKS; cur_x < LCD_WIDTH) {
-				// draw a pixel - for now only bg, ignoring delay
-				const auto sprite_px = process_sprite_fifo_px(static_cast<uint8_t>(cur_x + 8), LCDC);
-				
-				uint8_t bg_palette_color = TRANSPARENT;
-				const bool enable_bg_window = LCDC & 1;
-				if(enable_bg_window) {
-					const int window_x = static_cast<int>(cur_x) + 7 - static_cast<int>(lcd_window_x());
-					
-					uint8_t x, y; // tilemap x/y
-					bool tile_map;
-					if(get_bit(LCDC, 5) && window_x >= 0 && wy_cond_triggered) {
-						// TODO: if window disabled mid-line glitch occurs
-						x = static_cast<uint8_t>(window_x);
-						y = window_y_counter;
-						tile_map = get_bit(LCDC, 6);
-						wx_cond_triggered = true;
-					} else {
-						x = lcd_scroll_x() + static_cast<uint8_t>(cur_x);
-						y = lcd_scroll_y() + lcd_cur_y();
-						tile_map = get_bit(LCDC, 3);
-					}
-					
-					const uint8_t* tilemap_begin = mmu.vram_begin() + 0x1800 + (tile_map * 0x400); // 0x9800 if 0, 0x9C00 if 1
-					const uint8_t tile_idx_raw = tilemap_begin[(static_cast<uint16_t>(y >> 3) << 5) | (x >> 3)];
-					const uint8_t* bg_tiledata = mmu.vram_begin(); // 0x8000, LCDC.4 handled below
-					const uint16_t tile_idx = tile_idx_raw + (((~LCDC & 0b1'0000) << 4) & ((~tile_idx_raw & 0x80) << 1)); // add 256 if ~LCDC.4 and tile_idx >= 0;
-					const uint8_t* bg_tilerow = bg_tiledata + (((tile_idx * TILE_SZ) + (y & 7)) * 2);
-					bg_palette_color = ((bg_tilerow[0] >> (7-(x & 7))) & 1) | (((bg_tilerow[1] >> (7-(x & 7))) & 1) << 1);
-				}
-
-				constexpr static auto get_palette_color = [](uint8_t palette, uint8_t color) { return static_cast<uint8_t>((palette >> (2 * color)) & 3);};
-				Gray display_color{.raw = 0}; // default to white
-				if(sprite_px.color && (!sprite_px.low_prio || (bg_palette_color == 0))) {
-					const auto sprite_palette = obj_palettes()[sprite_px.palette];
-					display_color.raw = get_palette_color(sprite_palette, sprite_px.color);
-				} else if(bg_palette_color || enable_bg_window) {
-					display_color.raw = get_palette_color(bg_palette_data(), bg_palette_color);
-				}
-
-				// if sprite opaque and not low prio, use that.
-				// elif background color 1-3, use that.
-				// elif sprite opaque and low prio, use that.
-				// else render background color 0 if bg_enabled, or white otherwise.
-
-				// TODO: mixing here
-				frame[lcd_cur_y()][cur_x] = display_color;
-				if(cur_x == LCD_WIDTH - 1) next_mode = Mode::HBLANK;
-			}
+			if(renderer == Renderer::ACCURATE ? draw_tick(accurate_renderer) : draw_tick(fast_renderer)) next_mode = Mode::HBLANK;
 		}
 
 		if(EOL) {
@@ -105,6 +81,7 @@ struct PPU {
 				window_y_counter = 0;
 				wy_cond_triggered = false;
 				lcd_cur_y() = 0;
+				begin_frame();
 			};
 			if(lcd_cur_y() < LCD_HEIGHT) {
 				next_mode = Mode::RD_OAM;
@@ -113,39 +90,31 @@ struct PPU {
 				if(lcd_cur_y() == lcd_window_y()) wy_cond_triggered = true;
 			} else {
 				next_mode = Mode::VBLANK;
-				if(cur_mode != Mode::VBLANK) mmu.request_interrupt(memory::interrupt_bits::VBLANK);
+				if(cur_mode != Mode::VBLANK) {
+					mmu.request_interrupt(memory::interrupt_bits::VBLANK);
+					end_frame();
+				}
 			}
 		}
 		else {
 			++line_clks;
 			if(line_clks == MODE2_TCLKS && cur_mode == Mode::RD_OAM) {
 				next_mode = Mode::DRAW;
-				// simulate OAM scan. TODO handle DMA during mode 2?
-				const int obj_height = TILE_SZ + ((LCDC & 0b100) << 1);
-				remaining_objects = 0;
-				if(get_bit(LCDC, 1)) { // TODO: when does LCDC.1 actually have effects?
-					const auto& oam = this->oam();
-					for(uint8_t idx = 0; idx < oam.size(); ++idx) {
-						const auto& oam_entry = oam[idx];
-						const auto sprite_row = lcd_cur_y() - (oam_entry.y_plus_16 - 16);
-						if(sprite_row < 0 || sprite_row >= obj_height) continue;
-						scanned_objects[remaining_objects] = {
-							.idx = idx,
-							.x_plus_8 = oam_entry.x_plus_8,
-							.row_ignoring_flip = static_cast<uint8_t>(sprite_row),
-						};
-						++remaining_objects;
-						if(remaining_objects == scanned_objects.size()) break;
-					}
-				}
-				std::sort(scanned_objects.begin(), scanned_objects.begin()+remaining_objects, [](scanned_object a, scanned_object b){
-					if(a.x_plus_8 == b.x_plus_8) return a.idx > b.idx;
-					return a.x_plus_8 > b.x_plus_8;
-				});
-				// don't need to clear sprite fifo here because first 8 px are garbage anyway.
-				for(uint8_t x_plus_8 = 0; x_plus_8 < 8; ++x_plus_8) {
-					process_sprite_fifo_px(x_plus_8, LCDC);
+				LineSetup setup{
+					.objects = {},
+					.num_objects = 0,
+					.ly = lcd_cur_y(),
+					.window_y_counter = window_y_counter,
+					.wy_cond_triggered = wy_cond_triggered,
+				};
+				setup.scan_oam(video_memory());
+				Line* out = drawing_frame ? &frame[setup.ly] : nullptr;
+				if(recording_frame) {
+					deferred->line_setup(setup.ly) = setup;
+					out = nullptr;
 				}
+				if(renderer == Renderer::ACCURATE) accurate_renderer.begin_line(setup, video_memory(), out);
+				else fast_renderer.begin_line(setup, video_memory(), out);
 			}
 			// (DRAW -> HBLANK) transition handled above.
 		}
@@ -166,6 +135,8 @@ struct PPU {
 
 		lcd_status() = mask_combine<uint8_t>(0b0000'0111, lcd_status(), (lyc_equals_ly << 2) | static_cast<uint8_t>(next_mode));
 
+		if(recording_frame) deferred->write_log().now = DeferredRenderer::next_line(lcd_cur_y(), line_clks);
+
 		// TODO: copy objects into buffer at beginning of mode 2 and sort
 		// TODO: dma during mode 3 causes big issues.
 	}
@@ -190,6 +161,7 @@ struct PPU {
 		DUMP_DEC(lcd_scroll_x);
 		DUMP_DEC(lcd_window_x);
 		DUMP_DEC(lcd_window_y);
+		ret << "\nrenderer[" << (renderer == Renderer::ACCURATE ? "accurate" : "fast") << "]";
 		#undef DUMP_DEC
 		#undef DUMP_HEX
 		#undef DUMP_BIN
@@ -200,7 +172,65 @@ struct PPU {
 		return static_cast<Mode>(lcd_status() & 3);
 	}
 
+	// see gameboy_emulator::save_state(). the settings above (renderer, render mode, frame skip) aren't part of the state.
+	template<typename IO>
+	void save_state(IO& io) const {
+		if(deferred) deferred->wait(); // may still be drawing into frame
+		PackedFrame packed; // a quarter of the size, which matters for keeping lots of states around (rewinding)
+		pack(frame, packed);
+		io.bytes({reinterpret_cast<const uint8_t*>(packed.data()), sizeof(packed)}); // bulk, like memory (see StateLayout)
+		save_state_without_frame(io);
+	}
+
+	// the rest of the state: what's on screen doesn't affect what happens next, see gameboy_emulator::state_hash()
+	template<typename IO>
+	void save_state_without_frame(IO& io) const {
+		serialize(*this, io);
+		fast_renderer.save_state(io);
+		accurate_renderer.save_state(io);
+	}
+
+	// loading in the middle of a frame the deferred renderer is recording drops the recording, and the rest of the frame
+	// is drawn inline: lines above the save point keep whatever was on screen. only the picture is affected, for one frame.
+	void load_state(StateReader& io) {
+		if(deferred) deferred->wait();
+		PackedFrame packed;
+		io.bytes({reinterpret_cast<uint8_t*>(packed.data()), sizeof(packed)});
+		unpack(packed, frame);
+		serialize(*this, io);
+		fast_renderer.load_state(io);
+		accurate_renderer.load_state(io, lcd_cur_y() < LCD_HEIGHT ? &frame[lcd_cur_y()] : nullptr);
+		if(recording_frame) {
+			recording_frame = false;
+			mmu.set_video_write_log(nullptr);
+		}
+		drawing_frame = !skip_frames;
+	}
+
+	// for importing save states that don't have our internal state (see bess.h): pick up LY/LCDC as written from outside,
+	// starting over at the beginning of the current line.
+	void restart_line() {
+		if(deferred) deferred->wait();
+		if(recording_frame) {
+			recording_frame = false;
+			mmu.set_video_write_log(nullptr);
+		}
+		drawing_frame = !skip_frames;
+		stat_interrupt_wanted = false;
+		wx_cond_triggered = false;
+		line_clks = 0;
+		was_last_off = !get_bit(lcd_control(), 7);
+		const auto next_mode = was_last_off || lcd_cur_y() >= LCD_HEIGHT ? Mode::VBLANK : Mode::RD_OAM;
+		lcd_status() = mask_combine<uint8_t>(0b0000'0011, lcd_status(), static_cast<uint8_t>(next_mode));
+	}
+
 private:
+	template<typename Self, typename IO>
+	static void serialize(Self& self, IO& io) {
+		io(self.wy_cond_triggered); io(self.wx_cond_triggered); io(self.window_y_counter);
+		io(self.line_clks); io(self.was_last_off); io(self.stat_interrupt_wanted);
+		io(self.renderer); io(self.frames_without_mode3_writes);
+	}
 
 	// memory helpers - nice names + basic const correctness
 	[[nodiscard]] const uint8_t& lcd_control() const { return mmu.get<memory::addrs::LCD_CONTROL>(); };
@@ -213,88 +243,75 @@ private:
 	[[nodiscard]] const uint8_t& lcd_cmp_y() const { return mmu.get<memory::addrs::LCD_CMP_Y>(); };
 	[[nodiscard]] const uint8_t& oam_dma() const { return mmu.get<memory::addrs::OAM_DMA>(); };
 	[[nodiscard]] const uint8_t& bg_palette_data() const { return mmu.get<memory::addrs::BG_PALETTE_DATA>(); };
-	[[nodiscard]] auto obj_palettes() const { return std::span<const uint8_t, 2>{&mmu.get<memory::addrs::OBJ_PALETTE0_DATA>(), 2}; };
 	[[nodiscard]] const uint8_t& obj_palette0_data() const { return mmu.get<memory::addrs::OBJ_PALETTE0_DATA>(); }
 	[[nodiscard]] const uint8_t& obj_palette1_data() const { return mmu.get<memory::addrs::OBJ_PALETTE1_DATA>(); };
 	[[nodiscard]] const uint8_t& lcd_window_y() const { return mmu.get<memory::addrs::LCD_WINDOW_Y>(); };
 	[[nodiscard]] const uint8_t& lcd_window_x() const { return mmu.get<memory::addrs::LCD_WINDOW_X>(); };
 	
-	// TODO - would need testing on real hardware
-	struct scanned_object {
-		uint8_t idx;
-		uint8_t x_plus_8;
-		uint8_t row_ignoring_flip;
-	};
-	std::array<scanned_object, 10> scanned_objects; // sorted in reverse priority so we can pop from back
-	uint8_t remaining_objects = 0;
-
-	struct sprite_fifo_px {
-		uint8_t color : 2 = TRANSPARENT;
-		uint8_t palette: 1;
-		bool low_prio: 1;
-		// NOTE: on DMG only color is considered, on CGB we should also default to lower than lowest prio here.
-	};
-	std::array<sprite_fifo_px, 8> sprite_fifo{};
-	uint8_t sprite_fifo_head = 0;
-
 	// TODO: not emulating all of window's glitchy behavior
 	bool wy_cond_triggered = false;
 	bool wx_cond_triggered = false; 
 	uint8_t window_y_counter = 0;
 
-	// check for sprite(s) at current pixel,and load into fifo, then pop pixel off fifo
-	sprite_fifo_px process_sprite_fifo_px(uint8_t x_plus_8, uint8_t LCDC) {
-		const auto oam = this->oam();
-		while(remaining_objects > 0 && scanned_objects[remaining_objects-1].x_plus_8 == x_plus_8) {
-			const auto scanned_obj = scanned_objects[remaining_objects-1];
-			const oam_entry obj = oam[scanned_obj.idx];
-			const int obj_height = TILE_SZ + ((LCDC & 0b100) << 1);
-			const bool low_prio = get_bit(obj.flags, 7);
-			const bool y_flip = get_bit(obj.flags, 6);
-			const bool x_flip = get_bit(obj.flags, 5);
-			const bool palette = get_bit(obj.flags, 4);
-			auto y = scanned_obj.row_ignoring_flip;
-			if(y_flip) {
-				y ^= (obj_height - 1);
-			}
-			const auto base_tile_idx = obj.tile_idx & ~((LCDC >> 2) & 1); // if LCDC 1, zero last bit of idx
-			// TODO: what happens if we have change to using short objects in the middle of a frame and read past end?
-			const auto tiledata = mmu.vram_begin() + 2*(TILE_SZ*base_tile_idx + y);
-
-			uint8_t tiledata_lo = tiledata[0];
-			uint8_t tiledata_hi = tiledata[1]; 
-			for(uint8_t i = 0; i<8; ++i) {
-				const auto idx = (sprite_fifo_head + ((~-static_cast<int>(x_flip)) ^ i)) & 7; // LSB is rightmost, so i should be unchanged when x_flip is true
-				if(sprite_fifo[idx].color == TRANSPARENT) {
-					sprite_fifo[idx] = {
-						.color = static_cast<uint8_t>(((tiledata_hi & 1) << 1) | (tiledata_lo & 1)),
-						.palette = palette,
-						.low_prio = low_prio,
-					};
-				}
-				tiledata_lo >>= 1;
-				tiledata_hi >>= 1;
-			}
+	VideoMemoryView video_memory() const {
+		return {mmu.vram_begin(), mmu.ppu_oam(), &lcd_control()};
+	}
 
-			--remaining_objects;
-		}
+	// advance mode 3 by one dot, true once the line is done.
+	template<LineRenderer R>
+	bool draw_tick(R& r) {
+		if(!r.tick(video_memory())) return false;
+		wx_cond_triggered = r.window_drawn();
+		return true;
+	}
 
-		// pop from queue: clear/advance head
-		auto& head = sprite_fifo[sprite_fifo_head & 7];
-		const auto ret = head;
-		head = {};
-		sprite_fifo_head++; 
+	Renderer pick_renderer() {
+		if(requested_renderer != Renderer::AUTO) return requested_renderer;
+		// once we see mid-line writes, stay accurate for a while so effects that only happen every few frames aren't missed.
+		constexpr unsigned AUTO_ACCURATE_FRAMES = 60;
+		if(mmu.take_mode3_lcd_writes()) frames_without_mode3_writes = 0;
+		else if(frames_without_mode3_writes < AUTO_ACCURATE_FRAMES) ++frames_without_mode3_writes;
+		const auto ret = frames_without_mode3_writes < AUTO_ACCURATE_FRAMES ? Renderer::ACCURATE : Renderer::FAST;
+		if(ret != renderer) log_info("Switching to {} renderer", ret == Renderer::ACCURATE ? "accurate" : "fast");
 		return ret;
 	}
 
-	std::span<const oam_entry, NUM_OAM_ENTRIES> oam() const {
-		const auto& oam_view = mmu.oam_view();
-		return std::span<const oam_entry, NUM_OAM_ENTRIES>{
-			reinterpret_cast<const oam_entry*>(oam_view.data()),
-			reinterpret_cast<const oam_entry*>(oam_view.data()+oam_view.size())
-		};
+	// renderers and deferred rendering only change at frame boundaries, so a frame is never split between modes.
+	void begin_frame() {
+		renderer = pick_renderer();
+		render_mode = renderer == Renderer::ACCURATE ? RenderMode::INLINE : requested_render_mode;
+		drawing_frame = !skip_frames;
+		if(render_mode == RenderMode::INLINE) {
+			deferred.reset();
+			return;
+		}
+		if(!drawing_frame) return; // nothing to record, keep the deferred renderer for the next frame that's drawn
+		if(!deferred) deferred = std::make_unique<DeferredRenderer>();
+		// snapshot the real OAM even mid DMA, the log only has the writes from the DMA's start.
+		deferred->begin_frame({mmu.vram_begin(), mmu.oam_view().data(), &lcd_control()});
+		mmu.set_video_write_log(&deferred->write_log());
+		recording_frame = true;
+	}
+
+	void end_frame() {
+		if(!recording_frame) return;
+		recording_frame = false;
+		mmu.set_video_write_log(nullptr);
+		deferred->submit(frame);
+		if(render_mode == RenderMode::DEFERRED) deferred->wait();
 	}
 
+	ScanlineRenderer fast_renderer;
+	FifoRenderer accurate_renderer;
+	Renderer renderer = Renderer::FAST;
+	Renderer requested_renderer = Renderer::AUTO;
+	unsigned frames_without_mode3_writes = std::numeric_limits<unsigned>::max();
+	RenderMode render_mode = RenderMode::INLINE;
+	RenderMode requested_render_mode = RenderMode::INLINE;
+	std::unique_ptr<DeferredRenderer> deferred;
+	bool recording_frame = false;
+	bool skip_frames = false;
+	bool drawing_frame = true;
 
 	// starting state == end of vblank
 	uint16_t line_clks; // each tclk, counts up [0, LINE_TCLKS)
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "consts.h"
+#include "line_renderer.h"
+#include <gb/utils/state_io.h>
+
+namespace gb::ppu {
+
+// draws a whole line at once, with the registers as they are when mode 3 starts.
+// mode 3 always takes MODE3_MIN_TCLKS, and writes during mode 3 only show up on the next line.
+// good enough for most games, and much cheaper than FifoRenderer.
+class ScanlineRenderer {
+public:
+	void begin_line(const LineSetup& setup, const VideoMemoryView& mem, Line* out) {
+		drew_window = draws_window(setup, mem);
+		if(out) draw_line(setup, mem, *out);
+		dots = 0;
+	}
+
+	bool tick([[maybe_unused]] const VideoMemoryView& mem) {
+		return ++dots == MODE3_MIN_TCLKS;
+	}
+
+	bool window_drawn() const { return drew_window; }
+
+	static void draw_line(const LineSetup& setup, const VideoMemoryView& mem, Line& out);
+
+	[[nodiscard]] static bool draws_window(const LineSetup& setup, const VideoMemoryView& mem) {
+		return window_covers(mem.reg<memory::addrs::LCD_CONTROL>(), mem.reg<memory::addrs::LCD_WINDOW_X>(), LCD_WIDTH - 1, setup.wy_cond_triggered);
+	}
+
+	template<typename IO>
+	void save_state(IO& io) const { io(dots); io(drew_window); }
+	void load_state(StateReader& io) { io(dots); io(drew_window); }
+
+private:
+	unsigned dots = 0;
+	bool drew_window = false;
+};
+static_assert(LineRenderer<ScanlineRenderer>);
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <gb/gb.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+namespace gb {
+
+// keeps the last however many frames' save states, within a memory budget, to step back through.
+// only the newest is kept whole. each older one is stored as what changed from the next newer one: the XOR of the two,
+// in 256 byte pages, with unchanged pages left out and the rest run length encoded (most of a page that did change
+// still didn't). a frame usually changes a few KB of a ~40KB state, so that's some hundreds of bytes a frame.
+// every keyframe_interval captures one is also kept whole (encoded the same way, against zeros), so going far back
+// doesn't have to walk every frame in between.
+class Rewinder {
+public:
+	constexpr static size_t DEFAULT_BUDGET_BYTES = 64 << 20;
+	constexpr static unsigned DEFAULT_KEYFRAME_INTERVAL = 120;
+
+	explicit Rewinder(size_t budget_bytes = DEFAULT_BUDGET_BYTES, unsigned keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+
+	// the oldest captures are dropped to stay within budget.
+	void set_budget(size_t budget_bytes);
+	size_t budget() const { return budget_bytes; }
+	size_t memory_used() const { return used_bytes + latest.size(); }
+
+	// call once per frame.
+	void capture(gameboy_emulator& emulator);
+
+	// how many captures back we can go.
+	size_t depth() const { return entries.size(); }
+
+	// load the capture frames before the newest one, which becomes the newest (the ones after it are dropped).
+	// @return false if there's nothing that far back, in which case nothing changes.
+	bool rewind(gameboy_emulator& emulator, size_t frames = 1);
+
+	void clear();
+
+private:
+	constexpr static size_t PAGE_SIZE = 256;
+
+	struct entry {
+		std::vector<uint8_t> delta; // to get this capture from the next newer one, see encode()
+		std::vector<uint8_t> keyframe; // empty, or this capture encoded against zeros
+		size_t bytes() const { return delta.capacity() + keyframe.capacity(); }
+	};
+
+	// append the changes from base to target (base may be empty, for all zeros) to out:
+	// for each page that differs, its index (uint16_t) then the XOR of the two, as runs:
+	// a byte n < 128 for n + 1 zeros, or 128 + n followed by n + 1 literal bytes.
+	static void encode(std::span<const uint8_t> base, std::span<const uint8_t> target, std::vector<uint8_t>& out);
+	// XOR changes from encode() into state, turning base into target or back.
+	static void apply(std::span<const uint8_t> changes, std::span<uint8_t> state);
+
+	void evict();
+	void drop_newest();
+	void recycle(entry&& e);
+
+	size_t budget_bytes;
+	unsigned keyframe_interval;
+	std::deque<entry> entries; // oldest first
+	std::vector<entry> spare; // a few dropped entries, to reuse their memory
+	constexpr static size_t MAX_SPARE = 4;
+	size_t used_bytes = 0; // in entries
+	std::vector<uint8_t> latest; // the newest capture
+	std::vector<uint8_t> scratch;
+	uint64_t captures = 0;
+};
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <gb/gb.h>
+#include <gb/utils/thread_pool.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace gb::search {
+
+// searching for input that gets a game somewhere (tool-assisted runs, exploration): beam search over the buttons held
+// each step. every state on the beam is tried with every choice, spread over a thread pool, and the best scoring
+// children (by a function of RAM) make the next beam. children in exactly the same state as another are dropped, since
+// they'd go the same way from there.
+// states live as save states, each worker thread runs its own clone of the emulator (see gameboy_emulator::clone()).
+
+// what scoring looks at. high_mem is 0xFF00-0xFFFF: IO registers, HRAM and IE.
+struct ram_view {
+	std::span<const uint8_t> wram;
+	std::span<const uint8_t> high_mem;
+	std::span<const uint8_t> cartridge_ram;
+};
+
+// higher is better. called from the pool's threads, possibly several at once.
+using Scorer = std::function<double(const ram_view&)>;
+
+struct options {
+	std::vector<uint8_t> choices; // buttons to try holding each step, as bitmasks (see gameboy_emulator::held_buttons())
+	unsigned frames_per_step = 1;
+	unsigned depth = 10; // steps
+	size_t beam_width = 64;
+};
+
+struct result {
+	std::vector<uint8_t> inputs; // buttons held each step, from the start
+	double score = 0;
+	std::vector<uint8_t> state; // where that ends up, see gameboy_emulator::load_state(). nothing's drawn while searching, so its frame is stale
+	uint64_t expanded = 0; // children run
+	uint64_t duplicates = 0; // children dropped for being in the same state as another
+};
+
+// search from emulator's current state (which isn't changed), and return the best scoring state seen at any depth.
+// the result only depends on the arguments, not on the number of threads.
+result beam_search(gameboy_emulator& emulator, const options& opts, const Scorer& score, ThreadPool& pool = ThreadPool::shared());
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <gb/gb.h>
+#include <gb/ppu/packed_frame.h>
+#include <gb/utils/mapped_file.h>
+#include <gb/utils/worker_thread.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace gb::state_file {
+
+// save states on disk (quick saves, checkpoints of batch runs): a header saying what game (ROM hash), emulator version
+// (gameboy_emulator::STATE_VERSION) and frame it's from, a thumbnail of the screen, then the state itself, with its
+// memory sections (see StateLayout) compressed (see lz.h): in most games that's largely zeros and repeated tiles.
+// like save states, these only load into the same build. see bess.h for a format other emulators read.
+
+struct info {
+	uint64_t rom_hash = 0; // see gameboy_emulator::rom_hash()
+	uint64_t frame = 0; // whatever the saver counts frames from
+	uint32_t state_version = 0;
+	uint32_t state_size = 0;
+};
+
+// the whole file, for a save state with the given layout.
+std::vector<uint8_t> encode(std::span<const uint8_t> state, const StateLayout& layout, const info& header, const ppu::PackedFrame& thumbnail);
+
+// a file, read through a memory mapping: only what's asked for (the header, thumbnail or state) gets read in.
+class File {
+public:
+	explicit File(const std::filesystem::path& path);
+
+	const info& get_info() const { return header; }
+	void thumbnail(ppu::Frame& out) const;
+	// the save state, see gameboy_emulator::load_state(). out has to be get_info().state_size bytes.
+	void decode(std::span<uint8_t> out) const;
+	// throws unless it's for the game with this ROM hash and from this version.
+	void check_compatible(uint64_t rom_hash) const;
+	// checks it's for the emulator's game first (which hashes the whole ROM).
+	void load_into(gameboy_emulator& emulator) const;
+
+private:
+	struct section {
+		std::span<const uint8_t> stored;
+		uint32_t size; // stored is compressed unless it's this size
+	};
+
+	MappedFile file;
+	info header;
+	section thumbnail_section;
+	std::vector<section> sections;
+};
+
+// writes save state files on a background thread: save() only copies the state, compressing and writing happen later.
+// each file is written next to where it goes, then renamed over it, so there's never a half written file at path.
+// saves to the same path land in order.
+class Writer {
+public:
+	Writer();
+	~Writer(); // waits for everything queued
+	Writer(const Writer&) = delete;
+	Writer& operator=(const Writer&) = delete;
+
+	// only blocks if MAX_PENDING_BYTES of saves are already waiting, i.e. the disk can't keep up at all.
+	void save(gameboy_emulator& emulator, const std::filesystem::path& path, uint64_t frame);
+	// wait for everything queued so far to be written (or fail).
+	void flush();
+	// the state from the latest save to path that's still queued or being written, if any: it's the same as what'll be
+	// in the file, without waiting for it.
+	std::optional<std::vector<uint8_t>> pending_state(const std::filesystem::path& path) const;
+	// saves that failed (they're logged).
+	unsigned failures() const;
+
+	constexpr static size_t MAX_PENDING_BYTES = 64 << 20;
+
+private:
+	struct job {
+		std::filesystem::path path;
+		std::vector<uint8_t> state;
+		StateLayout layout;
+		info header;
+		ppu::PackedFrame thumbnail;
+		memory::SharedRom rom; // hashed on the worker, see rom_hash
+	};
+
+	void write(job& j); // on the worker
+
+	mutable std::mutex mutex;
+	std::condition_variable cv; // pending_bytes went down
+	std::deque<std::shared_ptr<job>> pending; // queued or being written, oldest first
+	size_t pending_bytes = 0;
+	unsigned failed = 0;
+	// worker only: the last ROM hashed, so it's only hashed once
+	memory::SharedRom hashed_rom;
+	uint64_t rom_hash = 0;
+	WorkerThread worker; // last member, so queued saves finish before the rest is destroyed
+};
+
+}
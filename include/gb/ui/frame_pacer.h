@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+namespace gb::ui {
+
+// schedules frames against the display's vsync, for a UI with an emulation thread and a render thread.
+// the render thread reports each (vsynced) swap, which gives the display's refresh period and phase.
+// if the display runs close enough to the emulated ~59.73 Hz, emulation is locked to it: one frame per vsync,
+// started as late as it can be while still being ready in time, so input is read as close to the photons as possible.
+// audio rate control absorbs the difference (60 Hz is ~0.45% fast). otherwise the UI paces some other way
+// (off audio, or a timer) and the display repeats or skips frames as needed.
+// times are in ns, from any monotonic clock.
+class FramePacer {
+public:
+	// how far the display can be from the emulated frame rate and still be locked to
+	constexpr static double MAX_RATE_DEVIATION = 0.005;
+	// slack left around emulation and rendering, for scheduling jitter
+	constexpr static uint64_t MARGIN_NS = 1'000'000;
+
+	struct stats {
+		double refresh_hz = 0; // 0 until measured
+		bool locked = false;
+		uint64_t late_frames = 0; // emulated frames that missed their deadline
+		uint64_t repeated_frames = 0; // swaps that showed the same frame again
+		uint64_t missed_vsyncs = 0; // swaps more than a refresh period apart
+	};
+
+	// optional starting guess for the refresh rate (e.g. from the display mode), measurement takes over from there.
+	explicit FramePacer(double refresh_hz_hint = 0);
+
+	// render thread. @return when to start drawing the next frame, or nullopt to draw right away (not locked).
+	std::optional<uint64_t> render_start() const;
+	// render thread, around drawing: begin is when it started, end is right before the swap.
+	void on_render_done(uint64_t begin_ns, uint64_t end_ns);
+	// render thread, right after a vsynced swap returns. @param new_frame whether it showed a frame not shown before.
+	void on_swap(uint64_t now_ns, bool new_frame);
+
+	// emulation thread. @return when to start emulating the next frame, or nullopt if not locked to the display.
+	std::optional<uint64_t> frame_start(uint64_t now_ns);
+	// emulation thread, once the frame is handed to the render thread.
+	void on_frame_done(uint64_t begin_ns, uint64_t end_ns);
+
+	bool locked() const;
+	// measured refresh rate, 0 until there's been enough swaps to tell.
+	double refresh_hz() const;
+	// counters since the last call (refresh_hz and locked are current).
+	stats take_stats();
+
+private:
+	constexpr static unsigned WARMUP_SWAPS = 30; // before the measured period is trusted
+
+	// costs are tracked as a slowly decaying maximum, so one fast frame doesn't make us cut it close.
+	static uint64_t track_cost(uint64_t old_cost, uint64_t cost) { return cost > old_cost ? cost : old_cost - old_cost / 64; }
+
+	// first vsync at or after t
+	uint64_t vsync_at_or_after(uint64_t t) const;
+
+	// written by the render thread
+	std::atomic<uint64_t> period_ns{0};
+	std::atomic<uint64_t> last_vsync_ns{0};
+	std::atomic<uint64_t> render_cost_ns{0};
+	unsigned swaps = 0; // consistent intervals seen
+	unsigned outliers = 0; // inconsistent intervals in a row
+
+	// emulation thread only
+	uint64_t frame_cost_ns = 0;
+	uint64_t frame_target = 0; // vsync the current frame is for
+	uint64_t frame_deadline = 0;
+
+	std::atomic<bool> warmed_up{false};
+	std::atomic<uint64_t> late_frames{0}, repeated_frames{0}, missed_vsyncs{0};
+};
+
+}
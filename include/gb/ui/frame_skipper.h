@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace gb::ui {
+
+// picks which frames to draw while emulation runs faster than the display: only about one per refresh gets shown,
+// so the rest can skip drawing (see ppu::PPU::set_frame_skip). the frame drawn is the last one that finishes before
+// the next refresh, going by how long drawn frames have been taking, so a slow host just skips fewer.
+// times are in ns, from any monotonic clock.
+class FrameSkipper {
+public:
+	explicit FrameSkipper(uint64_t display_period_ns) : period_ns{display_period_ns} {}
+
+	void set_display_period(uint64_t display_period_ns) { period_ns = display_period_ns; }
+
+	// whether the frame about to start at now_ns should be drawn.
+	bool should_draw(uint64_t now_ns) const { return now_ns + drawn_cost_ns >= next_draw_ns; }
+
+	void on_frame_done(bool drawn, uint64_t begin_ns, uint64_t end_ns) {
+		if(!drawn) return;
+		const uint64_t cost = end_ns - begin_ns;
+		drawn_cost_ns = drawn_cost_ns ? drawn_cost_ns - drawn_cost_ns / 8 + cost / 8 : cost;
+		// keep to the display's rhythm, unless we've fallen a whole refresh behind it
+		next_draw_ns = std::max(next_draw_ns, end_ns - std::min(end_ns, period_ns)) + period_ns;
+	}
+
+private:
+	uint64_t period_ns;
+	uint64_t drawn_cost_ns = 0;
+	uint64_t next_draw_ns = 0;
+};
+
+}
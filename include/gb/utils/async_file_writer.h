@@ -0,0 +1,59 @@
+#pragma once
+
+#include <gb/utils/worker_thread.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace gb {
+
+// writes a file on a background thread, so a slow disk never stalls whoever produces the data (e.g. emulation).
+// write() only copies into the current chunk; full chunks are queued for the writer thread.
+// chunk buffers are recycled, so steady state streaming doesn't allocate.
+class AsyncFileWriter {
+public:
+	explicit AsyncFileWriter(const std::filesystem::path& path);
+	~AsyncFileWriter(); // calls close(), but swallows errors
+	AsyncFileWriter(const AsyncFileWriter&) = delete;
+	AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+	void write(std::span<const uint8_t> data);
+	// overwrite bytes already written (e.g. size fields in a header), in order with everything else.
+	void write_at(uint64_t offset, std::span<const uint8_t> data);
+
+	// write everything queued and close the file. throws if any write failed.
+	void close();
+
+	// bytes passed to write() so far, whether or not they've reached the disk yet.
+	uint64_t size() const { return total_bytes; }
+
+	constexpr static size_t CHUNK_BYTES = 1 << 16;
+
+private:
+	struct job {
+		std::vector<uint8_t> data;
+		std::optional<uint64_t> offset; // append if nullopt
+	};
+
+	void flush_chunk();
+	void queue(job j);
+	void write_job(job& j); // on the worker
+
+	std::ofstream file; // only touched by the worker until close()
+	std::vector<uint8_t> chunk; // producer only
+	uint64_t total_bytes = 0;
+	bool closed = false;
+
+	std::mutex mutex;
+	std::vector<std::vector<uint8_t>> spare; // written chunks, for reuse
+	bool failed = false;
+	WorkerThread worker; // last member, so queued writes finish before the rest is destroyed
+};
+
+}
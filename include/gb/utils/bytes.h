@@ -0,0 +1,32 @@
+#pragma once
+
+#include <gb/utils/log.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+namespace gb {
+
+// for our own file formats (see movie.h, state_file.h), which are plain structs in this machine's byte order.
+
+template<typename T>
+std::span<const uint8_t> as_bytes(const T& value) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	return {reinterpret_cast<const uint8_t*>(&value), sizeof(T)};
+}
+
+// the T at pos in file, which doesn't have to be aligned. throws that what (e.g. "Movie") is cut off if it doesn't fit.
+template<typename T>
+T read_at(std::span<const uint8_t> file, size_t pos, std::string_view what) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	if(pos > file.size() || sizeof(T) > file.size() - pos) throw_exc("{} cut off at {} bytes", what, file.size());
+	T ret;
+	std::memcpy(&ret, file.data() + pos, sizeof(T));
+	return ret;
+}
+
+}
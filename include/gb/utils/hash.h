@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+// incrementally maintained state hash, see gameboy_emulator::state_hash(). off by default, since it puts a few
+// multiplies on every memory write. set with the GB_STATE_HASH CMake option.
+#ifndef GB_STATE_HASH
+#define GB_STATE_HASH 0
+#endif
+
+namespace gb {
+
+// 64-bit FNV-1a, fed incrementally: hashing a stream in pieces gives the same digest as hashing it all at once.
+// not cryptographic, just for checking outputs (audio, frames) against known good runs.
+class Fnv1a64 {
+public:
+	constexpr static uint64_t OFFSET_BASIS = 0xcbf2'9ce4'8422'2325;
+	constexpr static uint64_t PRIME = 0x100'0000'01b3;
+
+	constexpr void update(std::span<const uint8_t> bytes) {
+		for(const uint8_t b : bytes) {
+			state = (state ^ b) * PRIME;
+		}
+	}
+
+	// hash the bytes of trivially copyable values, in this machine's byte order.
+	template<typename T>
+	void update_values(std::span<const T> values) {
+		static_assert(std::is_trivially_copyable_v<T>);
+		update({reinterpret_cast<const uint8_t*>(values.data()), values.size_bytes()});
+	}
+
+	[[nodiscard]] constexpr uint64_t digest() const { return state; }
+
+private:
+	uint64_t state = OFFSET_BASIS;
+};
+
+// fast 64-bit hash of a whole buffer, for spotting changes (e.g. skipping frames identical to the last one).
+// goes 8 bytes at a time over 4 independent lanes, so it's several times faster than Fnv1a64 on anything big,
+// but it isn't incremental and the digest depends on byte order, so don't store it anywhere.
+inline uint64_t fast_hash(std::span<const uint8_t> bytes) {
+	constexpr uint64_t P1 = 0x9e37'79b1'85eb'ca87, P2 = 0xc2b2'ae3d'27d4'eb4f;
+	const auto word = [&](size_t i) { uint64_t w; std::memcpy(&w, bytes.data() + i, sizeof w); return w; };
+	const auto round = [](uint64_t acc, uint64_t w) { return std::rotl(acc + w * P2, 31) * P1; };
+
+	std::array<uint64_t, 4> lanes{P1 + P2, P2, 0, 0 - P1};
+	size_t i = 0;
+	for(; i + 32 <= bytes.size(); i += 32) {
+		for(size_t lane = 0; lane < lanes.size(); ++lane) lanes[lane] = round(lanes[lane], word(i + 8 * lane));
+	}
+	uint64_t h = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18) + bytes.size();
+	for(; i + 8 <= bytes.size(); i += 8) h = std::rotl(h ^ round(0, word(i)), 27) * P1 + P2;
+	for(; i < bytes.size(); ++i) h = std::rotl(h ^ (bytes[i] * P1), 11) * P2;
+	// make every input bit affect every output bit
+	h ^= h >> 33; h *= P2;
+	h ^= h >> 29; h *= P1;
+	return h ^ (h >> 32);
+}
+
+// hash of a set of (location, byte) pairs that's kept up to date a byte at a time: the digest is the sum of a mix of
+// each pair, so changing one byte takes out its old pair and puts in the new one, O(1) however much memory is covered.
+// the order things are added in doesn't matter. like fast_hash(), only for comparing within a run.
+class MultisetHash {
+public:
+	MultisetHash() = default;
+	explicit MultisetHash(uint64_t digest) : sum{digest} {}
+
+	void update(uint32_t location, uint8_t old_value, uint8_t new_value) {
+		sum += term(location, new_value) - term(location, old_value);
+	}
+
+	void add(uint32_t first_location, std::span<const uint8_t> bytes) {
+		for(size_t i = 0; i < bytes.size(); ++i) sum += term(first_location + static_cast<uint32_t>(i), bytes[i]);
+	}
+
+	void remove(uint32_t first_location, std::span<const uint8_t> bytes) {
+		for(size_t i = 0; i < bytes.size(); ++i) sum -= term(first_location + static_cast<uint32_t>(i), bytes[i]);
+	}
+
+	void clear() { sum = 0; }
+
+	[[nodiscard]] uint64_t digest() const { return sum; }
+
+private:
+	// splitmix64's finalizer: a sum of these doesn't cancel out the way a sum of the raw pairs would
+	static constexpr uint64_t term(uint32_t location, uint8_t value) {
+		uint64_t x = (uint64_t{location} << 8) | value;
+		x = (x ^ (x >> 30)) * 0xbf58'476d'1ce4'e5b9;
+		x = (x ^ (x >> 27)) * 0x94d0'49bb'1331'11eb;
+		return x ^ (x >> 31);
+	}
+
+	uint64_t sum = 0;
+};
+
+}
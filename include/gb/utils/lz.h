@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace gb::lz {
+
+// fast LZ77 compression in LZ4's block format (sequences of literals + a back reference of at least 4 bytes within
+// 64KB), so any LZ4 block decoder can read what compress() writes. nowhere near as tight as deflate, but it goes at
+// memory speed in both directions, which is what matters for save states: mostly runs of zeros and repeated tiles.
+
+// the most compress() can write for size input bytes.
+constexpr size_t max_compressed_size(size_t size) { return size + size / 255 + 16; }
+
+// append the compressed form of in to out.
+void compress(std::span<const uint8_t> in, std::vector<uint8_t>& out);
+
+// decompress into exactly out.size() bytes. throws if in is broken or decompresses to a different size.
+void decompress(std::span<const uint8_t> in, std::span<uint8_t> out);
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace gb {
+
+// a file mapped into memory, read only: reading it pages it in from the OS's cache, without copying it all in first.
+// the file shouldn't be changed while it's mapped (replacing it by renaming another file over it is fine).
+class MappedFile {
+public:
+	explicit MappedFile(const std::filesystem::path& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	std::span<const uint8_t> bytes() const { return {data, size}; }
+
+private:
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* mapping = nullptr; // HANDLE
+#endif
+};
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// compile-time SIMD feature detection.
+// SSE2 is part of the x86-64 baseline, so every 64-bit x86 build gets it for free.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GB_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define GB_SIMD_SSE2 0
+#endif
+
+// AVX2 isn't baseline, so AVX2 (+FMA) code is compiled per function with GB_TARGET_AVX2,
+// and must only be called if gb::simd::cpu_has_avx2().
+#if GB_SIMD_SSE2
+#define GB_SIMD_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define GB_TARGET_AVX2 // MSVC allows any intrinsic anywhere
+#else
+#define GB_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace gb::simd {
+
+inline bool cpu_has_avx2() {
+	static const bool ret = []{
+#if defined(_MSC_VER) && !defined(__clang__)
+		int regs[4];
+		__cpuid(regs, 1);
+		const bool fma = regs[2] & (1 << 12);
+		const bool os_saves_ymm = (regs[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, and XMM + YMM state enabled
+		__cpuidex(regs, 7, 0);
+		return fma && os_saves_ymm && (regs[1] & (1 << 5));
+#else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}();
+	return ret;
+}
+
+}
+#else
+#define GB_SIMD_AVX2 0
+#endif
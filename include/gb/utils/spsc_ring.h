@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace gb {
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4324) // padded due to alignas, which is the point
+#endif
+
+// lock-free ring buffer for exactly one producer thread and one consumer thread, e.g. emulation -> audio callback.
+// neither side ever blocks: push() writes what fits, pop() reads what's there.
+template<typename T>
+class SpscRing {
+	static_assert(std::is_trivially_copyable_v<T>);
+public:
+	// capacity is rounded up to a power of 2.
+	explicit SpscRing(size_t min_capacity) : buf(std::bit_ceil(std::max<size_t>(min_capacity, 2))) {}
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	size_t capacity() const { return buf.size(); }
+
+	// approximate from either side, exact from the producer for free space and from the consumer for data.
+	size_t size() const { return write_pos.load(std::memory_order_acquire) - read_pos.load(std::memory_order_acquire); }
+
+	// producer only. @return number of elements written, less than in.size() if the ring is full.
+	size_t push(std::span<const T> in) {
+		const size_t w = write_pos.load(std::memory_order_relaxed);
+		const size_t r = read_pos.load(std::memory_order_acquire);
+		const size_t count = std::min(in.size(), capacity() - (w - r));
+		copy_in(w, in.first(count));
+		write_pos.store(w + count, std::memory_order_release);
+		return count;
+	}
+
+	// consumer only. @return number of elements read, less than out.size() if the ring ran dry.
+	size_t pop(std::span<T> out) {
+		const size_t r = read_pos.load(std::memory_order_relaxed);
+		const size_t w = write_pos.load(std::memory_order_acquire);
+		const size_t count = std::min(out.size(), w - r);
+		const size_t idx = r & (capacity() - 1);
+		const size_t first = std::min(count, capacity() - idx);
+		std::copy_n(buf.begin() + idx, first, out.begin());
+		std::copy_n(buf.begin(), count - first, out.begin() + first);
+		read_pos.store(r + count, std::memory_order_release);
+		return count;
+	}
+
+private:
+	void copy_in(size_t w, std::span<const T> in) {
+		const size_t idx = w & (capacity() - 1);
+		const size_t first = std::min(in.size(), capacity() - idx);
+		std::copy_n(in.begin(), first, buf.begin() + idx);
+		std::copy_n(in.begin() + first, in.size() - first, buf.begin());
+	}
+
+	// positions only ever increase (wrapping is fine, capacity is a power of 2).
+	// kept on separate cache lines so the two threads don't fight over them.
+	// NOTE: std::hardware_destructive_interference_size isn't everywhere yet.
+	constexpr static size_t CACHE_LINE = 64;
+	alignas(CACHE_LINE) std::atomic<size_t> write_pos{0};
+	alignas(CACHE_LINE) std::atomic<size_t> read_pos{0};
+	alignas(CACHE_LINE) std::vector<T> buf;
+};
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+}
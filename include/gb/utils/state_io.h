@@ -0,0 +1,122 @@
+#pragma once
+
+#include <gb/utils/hash.h>
+#include <gb/utils/log.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace gb {
+
+// flat binary (de)serialization for save states, see gameboy_emulator::save_state().
+// each component lists its fields once, in a template used for both directions:
+//   template<typename Self, typename IO> static void serialize(Self& self, IO& io) { io(self.a); io(self.b); }
+// with Self const for saving. fields are copied as raw bytes in this machine's byte order, so only plain values go in
+// (no pointers), and the layout is only meant for this build. see bess.h for a format that can be kept around.
+
+// counts the bytes a save would take.
+class StateSizer {
+public:
+	template<typename T>
+	void operator()(const T&) { pos += sizeof(T); }
+	void bytes(std::span<const uint8_t> data) { pos += data.size(); }
+	size_t size() const { return pos; }
+
+private:
+	size_t pos = 0;
+};
+
+// which parts of a save are bulk memory (bytes()) and which are everything else, see PageStore.
+class StateLayout {
+public:
+	struct section {
+		size_t offset;
+		size_t size;
+		bool memory;
+	};
+
+	template<typename T>
+	void operator()(const T&) { append(sizeof(T), false); }
+	void bytes(std::span<const uint8_t> data) { append(data.size(), true); }
+	const std::vector<section>& sections() const { return parts; }
+	size_t size() const { return pos; }
+
+private:
+	void append(size_t n, bool memory) {
+		if(!n) return;
+		if(!memory && !parts.empty() && !parts.back().memory) parts.back().size += n; // memory sections stay separate
+		else parts.push_back({.offset = pos, .size = n, .memory = memory});
+		pos += n;
+	}
+
+	std::vector<section> parts;
+	size_t pos = 0;
+};
+
+class StateWriter {
+public:
+	explicit StateWriter(std::span<uint8_t> out) : out{out} {}
+
+	template<typename T>
+	void operator()(const T& value) {
+		static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>);
+		bytes({reinterpret_cast<const uint8_t*>(&value), sizeof(T)});
+	}
+
+	void bytes(std::span<const uint8_t> data) {
+		if(data.size() > out.size() - pos) throw_exc("Save state buffer of {} bytes too small", out.size());
+		std::memcpy(out.data() + pos, data.data(), data.size());
+		pos += data.size();
+	}
+
+	size_t size() const { return pos; }
+
+private:
+	std::span<uint8_t> out;
+	size_t pos = 0;
+};
+
+class StateReader {
+public:
+	explicit StateReader(std::span<const uint8_t> in) : in{in} {}
+
+	template<typename T>
+	void operator()(T& value) {
+		static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>);
+		bytes({reinterpret_cast<uint8_t*>(&value), sizeof(T)});
+	}
+
+	void bytes(std::span<uint8_t> data) {
+		if(data.size() > in.size() - pos) throw_exc("Save state truncated at {} bytes", in.size());
+		std::memcpy(data.data(), in.data() + pos, data.size());
+		pos += data.size();
+	}
+
+	size_t remaining() const { return in.size() - pos; }
+
+private:
+	std::span<const uint8_t> in;
+	size_t pos = 0;
+};
+
+// hashes the fields a save would have, except for bulk memory (bytes()), which gameboy_emulator::state_hash() keeps
+// track of as it's written instead.
+class StateHasher {
+public:
+	template<typename T>
+	void operator()(const T& value) {
+		static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>);
+		hash.update_values(std::span{&value, 1});
+	}
+	void bytes(std::span<const uint8_t>) {}
+	uint64_t digest() const { return hash.digest(); }
+
+private:
+	Fnv1a64 hash;
+};
+
+}
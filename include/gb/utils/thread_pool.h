@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace gb {
+
+// tracks completion of a batch of tasks submitted to a ThreadPool.
+// the first exception thrown by a task is rethrown from ThreadPool::wait().
+class TaskGroup {
+public:
+	[[nodiscard]] bool finished() const {
+		std::lock_guard lock{mutex};
+		return pending == 0;
+	}
+
+private:
+	friend class ThreadPool;
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+	size_t pending = 0;
+	std::exception_ptr exception;
+};
+
+// fixed-size pool of worker threads.
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned num_threads = default_num_threads());
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(TaskGroup& group, std::function<void()> task);
+
+	// block until every task in group has finished. the calling thread runs group's queued tasks while it waits (but no
+	// others), so this is safe to call from inside a task.
+	void wait(TaskGroup& group);
+
+	// run fn(i) for every i in [0, count) across the pool, and wait for all of them.
+	void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+	[[nodiscard]] unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+	static unsigned default_num_threads();
+	static ThreadPool& shared(); // construct on first use
+
+private:
+	struct queued_task {
+		TaskGroup* group;
+		std::function<void()> fn;
+	};
+
+	void worker_loop(std::stop_token stop);
+	static void run(queued_task& task);
+
+	std::mutex mutex;
+	std::condition_variable_any cv;
+	std::deque<queued_task> tasks;
+	std::vector<std::jthread> workers; // last member, so threads stop before the queue is destroyed
+};
+
+}
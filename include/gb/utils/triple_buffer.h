@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace gb {
+
+// lock-free handoff of the latest value from one producer thread to one consumer thread (e.g. finished frames to the renderer).
+// the producer always has a buffer to write into and the consumer always has a complete one to read,
+// a third buffer in the middle is swapped with either side. values the consumer never picked up are overwritten.
+template<typename T>
+class TripleBuffer {
+public:
+	// producer: the buffer to fill in. contents are whatever was there 2 publishes ago.
+	T& back() { return bufs[back_idx]; }
+
+	// producer: hand back() over to the consumer.
+	void publish() {
+		back_idx = middle.exchange(static_cast<uint8_t>(back_idx | FRESH), std::memory_order_acq_rel) & INDEX;
+	}
+
+	// consumer: pick up the newest published value, if there's one we haven't seen. @return whether front() changed.
+	bool update() {
+		if(!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+		front_idx = middle.exchange(front_idx, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// consumer: the last value picked up by update().
+	const T& front() const { return bufs[front_idx]; }
+
+private:
+	constexpr static uint8_t INDEX = 3;
+	constexpr static uint8_t FRESH = 4; // set in middle when the producer has published since the consumer last swapped
+
+	std::array<T, 3> bufs{};
+	uint8_t back_idx = 0; // producer only
+	uint8_t front_idx = 1; // consumer only
+	std::atomic<uint8_t> middle{2};
+};
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <gb/utils/async_file_writer.h>
+#include <gb/utils/log.h>
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace gb {
+
+// streams interleaved 16 bit PCM to a .wav file (or a headerless .raw file), written in the background.
+// the header's sizes are patched in by close().
+class WavWriter {
+public:
+	enum class Format : uint8_t { WAV, RAW };
+
+	static Format format_for(const std::filesystem::path& path) {
+		return path.extension() == ".raw" ? Format::RAW : Format::WAV;
+	}
+
+	WavWriter(const std::filesystem::path& path, uint32_t sample_rate, uint16_t channels)
+		: format{format_for(path)}, file{path}
+	{
+		if(format == Format::WAV) write_header(sample_rate, channels, 0);
+	}
+
+	~WavWriter() {
+		try {
+			close();
+		} catch (const std::exception& e) {
+			log_error("Error closing wav file: {}", e.what());
+		}
+	}
+
+	void write(std::span<const int16_t> samples) {
+		static_assert(std::endian::native == std::endian::little, "wav data is little endian");
+		file.write({reinterpret_cast<const uint8_t*>(samples.data()), samples.size_bytes()});
+	}
+
+	void close() {
+		if(closed) return;
+		closed = true;
+		if(format == Format::WAV) {
+			const auto data_bytes = static_cast<uint32_t>(file.size() - HEADER_BYTES);
+			put32(RIFF_SIZE_OFFSET, HEADER_BYTES - 8 + data_bytes);
+			put32(DATA_SIZE_OFFSET, data_bytes);
+		}
+		file.close();
+	}
+
+private:
+	constexpr static uint32_t HEADER_BYTES = 44;
+	constexpr static uint64_t RIFF_SIZE_OFFSET = 4;
+	constexpr static uint64_t DATA_SIZE_OFFSET = 40;
+
+	void write_header(uint32_t sample_rate, uint16_t channels, uint32_t data_bytes) {
+		std::array<uint8_t, HEADER_BYTES> header{};
+		size_t pos = 0;
+		const auto tag = [&](const char (&s)[5]) { for(int i = 0; i < 4; ++i) header[pos++] = static_cast<uint8_t>(s[i]); };
+		const auto le = [&](uint32_t v, int bytes) { for(int i = 0; i < bytes; ++i) header[pos++] = static_cast<uint8_t>(v >> (8 * i)); };
+		tag("RIFF"); le(HEADER_BYTES - 8 + data_bytes, 4); tag("WAVE");
+		tag("fmt "); le(16, 4);
+		le(1, 2); // PCM
+		le(channels, 2);
+		le(sample_rate, 4);
+		le(sample_rate * channels * 2, 4); // bytes per second
+		le(channels * 2u, 2); // bytes per frame
+		le(16, 2); // bits per sample
+		tag("data"); le(data_bytes, 4);
+		file.write(header);
+	}
+
+	void put32(uint64_t offset, uint32_t v) {
+		const std::array<uint8_t, 4> bytes{static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 24)};
+		file.write_at(offset, bytes);
+	}
+
+	Format format;
+	AsyncFileWriter file;
+	bool closed = false;
+};
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+
+namespace gb {
+
+// a thread of its own that runs jobs one at a time, in the order they were submitted.
+// for background work that has to stay in order (e.g. writing a file), see ThreadPool for work that doesn't.
+class WorkerThread {
+public:
+	WorkerThread();
+	~WorkerThread(); // runs everything queued first
+	WorkerThread(const WorkerThread&) = delete;
+	WorkerThread& operator=(const WorkerThread&) = delete;
+
+	// job mustn't throw.
+	void submit(std::function<void()> job);
+
+	// block until every job submitted so far has run.
+	void wait();
+
+private:
+	void loop(std::stop_token stop);
+
+	std::mutex mutex;
+	std::condition_variable_any cv;
+	std::deque<std::function<void()>> jobs;
+	bool running = false; // the thread holds a job
+	std::jthread thread; // last member, so the thread stops before the queue is destroyed
+};
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <gb/consts.h>
+#include <gb/ppu/packed_frame.h>
+#include <gb/utils/async_file_writer.h>
+#include <gb/utils/log.h>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <string>
+
+namespace gb {
+
+// streams frames to a YUV4MPEG2 (.y4m) file, written in the background. DMG frames are gray, so it's luma only
+// ("mono"), which ffmpeg and friends read fine, e.g. ffmpeg -i in.y4m -vf scale=640:-1:flags=neighbor out.mp4
+class Y4mWriter {
+public:
+	explicit Y4mWriter(const std::filesystem::path& path) : file{path} {
+		// the exact frame rate, as clocks per second over clocks per frame
+		const auto header = std::format("YUV4MPEG2 W{} H{} F{}:{} Ip A1:1 Cmono\n", ppu::LCD_WIDTH, ppu::LCD_HEIGHT,
+			static_cast<uint32_t>(consts::TCLK_HZ), ppu::LINE_TCLKS * (ppu::LCD_HEIGHT + ppu::VBLANK_LINES));
+		file.write({reinterpret_cast<const uint8_t*>(header.data()), header.size()});
+	}
+
+	~Y4mWriter() {
+		try {
+			close();
+		} catch (const std::exception& e) {
+			log_error("Error closing y4m file: {}", e.what());
+		}
+	}
+
+	void write(const ppu::Frame& frame) {
+		constexpr static std::array<uint8_t, 6> FRAME_HEADER{'F', 'R', 'A', 'M', 'E', '\n'};
+		file.write(FRAME_HEADER);
+		for(const auto& line : frame) {
+			std::array<uint8_t, ppu::LCD_WIDTH> luma;
+			for(unsigned x = 0; x < ppu::LCD_WIDTH; ++x) luma[x] = LUMA[line[x].raw & 3];
+			file.write(luma);
+		}
+		++frame_count;
+	}
+
+	void close() {
+		if(closed) return;
+		closed = true;
+		file.close();
+	}
+
+	uint64_t frames() const { return frame_count; }
+
+private:
+	// same levels as GRAYSCALE_PALETTE
+	constexpr static std::array<uint8_t, 4> LUMA{0xFF, 0xAA, 0x55, 0x00};
+
+	AsyncFileWriter file;
+	uint64_t frame_count = 0;
+	bool closed = false;
+};
+
+}
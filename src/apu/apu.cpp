@@ -0,0 +1,393 @@
+#include <gb/apu/apu.h>
+
+#include <algorithm>
+
+namespace gb::apu {
+
+namespace {
+
+// each channel's DAC outputs -15 to 15 (when on), the mix of 4 channels is scaled by 1-8 (NR50),
+// so the total is within +-480. leaves a lot of headroom in int16 for the high pass filter.
+constexpr int32_t OUTPUT_SCALE = 32;
+
+}
+
+void APU::reset() {
+	log_debug("Resetting APU");
+	// everything but wave ram is cleared, and the APU is off.
+	audio_regs.fill(0);
+	pulse = {};
+	wave = {};
+	noise = {};
+	frame_sequencer_next = NEVER;
+	frame_sequencer_step = 0;
+	update_stepping();
+	update_output();
+}
+
+void APU::write(uint16_t addr, uint8_t data) {
+	using namespace addrs;
+	if(addr < AUDIOS_BEGIN || addr >= AUDIOS_END) throw_exc();
+
+	if(addr >= WAVETABLE_RAM_BEGIN) {
+		wave_table[addr - WAVETABLE_RAM_BEGIN] = data;
+		return;
+	}
+
+	uint8_t& mem = reg(addr);
+
+	const bool was_enabled = apu_enabled();
+	if(addr == NR52) {
+		// always writable, even if not enabled
+		if(get_bit(data, 7) && !was_enabled) {
+			log_info("Enabling APU");
+			mem = 0x80;
+			frame_sequencer_step = 0;
+			frame_sequencer_next = next_div_edge(now);
+		} else if(was_enabled && !get_bit(data, 7)) {
+			reset();
+		}
+		return;
+	}
+
+	if(!was_enabled) [[unlikely]] {
+		log_warn("Ignoring write to {:#06x} while APU off", addr);
+		return;
+	}
+
+	if(addr == NR43) flush_lfsr(); // owed shifts happen in the old mode
+	mem = data;
+	switch(addr) {
+		case NR11: case NR21:
+			pulse[addr == NR21].length = static_cast<uint16_t>(64 - (data & 63));
+			break;
+		case NR31:
+			wave.length = static_cast<uint16_t>(256 - data);
+			break;
+		case NR41:
+			noise.length = static_cast<uint16_t>(64 - (data & 63));
+			break;
+		case NR12: case NR22:
+			if(!(data & 0xF8)) pulse[addr == NR22].enabled = false; // DAC off
+			break;
+		case NR30:
+			if(!get_bit(data, 7)) wave.enabled = false;
+			break;
+		case NR42:
+			if(!(data & 0xF8)) noise.enabled = false;
+			break;
+		case NR43:
+			if(noise.enabled) {
+				const auto period = noise_period();
+				noise.next_clock = period == NEVER ? NEVER : now + period;
+			}
+			break;
+		case NR14: case NR24:
+			if(get_bit(data, 7)) trigger_pulse(addr == NR24);
+			break;
+		case NR34:
+			if(get_bit(data, 7)) trigger_wave();
+			break;
+		case NR44:
+			if(get_bit(data, 7)) trigger_noise();
+			break;
+	}
+	update_stepping();
+	update_output();
+}
+
+void APU::set_div(uint64_t clock, uint8_t div) {
+	run_until(clock);
+	div_origin = static_cast<uint8_t>(clock / DIV_TCLKS - div);
+	if(!apu_enabled()) return;
+	frame_sequencer_next = next_div_edge(clock);
+	update_stepping();
+}
+
+void APU::reset_div(uint64_t clock) {
+	run_until(clock);
+	const bool falling = get_bit(div_at(clock), 4);
+	set_div(clock, 0);
+	if(!falling || !apu_enabled()) return;
+	catch_up(now); // the frame sequencer can make a channel audible
+	clock_frame_sequencer();
+	update_stepping();
+	update_output();
+}
+
+uint64_t APU::noise_period() {
+	const uint8_t nr43 = reg<addrs::NR43>();
+	const unsigned shift = nr43 >> 4;
+	if(shift >= 14) return NEVER; // LFSR isn't clocked at all
+	const unsigned divisor = (nr43 & 7) ? (nr43 & 7) * 16 : 8;
+	return static_cast<uint64_t>(divisor) << shift;
+}
+
+void APU::trigger_pulse(unsigned i) {
+	auto& ch = pulse[i];
+	const uint8_t nrx2 = reg(pulse_regs(i) + 2);
+	ch.enabled = nrx2 & 0xF8; // DAC on
+	if(!ch.length) ch.length = 64;
+	ch.next_clock = now + (2048 - pulse_freq(i)) * 4;
+	ch.env.trigger(nrx2);
+	if(i == 0) {
+		const uint8_t nr10 = reg<addrs::NR10>();
+		const uint8_t period = (nr10 >> 4) & 7;
+		ch.shadow_freq = pulse_freq(0);
+		ch.sweep_timer = period ? period : 8;
+		ch.sweep_enabled = period || (nr10 & 7);
+		if(nr10 & 7) calc_sweep();
+	}
+}
+
+void APU::trigger_wave() {
+	wave.enabled = get_bit(reg<addrs::NR30>(), 7);
+	if(!wave.length) wave.length = 256;
+	wave.pos = 0;
+	// TODO: the first sample played is the one left over from before the trigger
+	wave.next_clock = now + (2048 - wave_freq()) * 2;
+}
+
+void APU::trigger_noise() {
+	const uint8_t nr42 = reg<addrs::NR42>();
+	noise.enabled = nr42 & 0xF8;
+	if(!noise.length) noise.length = 64;
+	noise.lfsr = 0x7FFF;
+	noise.lfsr_pending = 0;
+	noise.env.trigger(nr42);
+	const auto period = noise_period();
+	noise.next_clock = period == NEVER ? NEVER : now + period;
+}
+
+uint16_t APU::calc_sweep() {
+	const uint8_t nr10 = reg<addrs::NR10>();
+	auto& ch = pulse[0];
+	const uint16_t delta = ch.shadow_freq >> (nr10 & 7);
+	const uint16_t new_freq = get_bit(nr10, 3) ? ch.shadow_freq - delta : ch.shadow_freq + delta;
+	if(new_freq > 2047) ch.enabled = false;
+	return new_freq;
+}
+
+void APU::clock_sweep() {
+	auto& ch = pulse[0];
+	const uint8_t nr10 = reg<addrs::NR10>();
+	const uint8_t period = (nr10 >> 4) & 7;
+	if(ch.sweep_timer) --ch.sweep_timer;
+	if(ch.sweep_timer) return;
+	ch.sweep_timer = period ? period : 8;
+	if(!ch.sweep_enabled || !period) return;
+	const uint16_t new_freq = calc_sweep();
+	if(new_freq <= 2047 && (nr10 & 7)) {
+		ch.shadow_freq = new_freq;
+		reg<addrs::NR13>() = static_cast<uint8_t>(new_freq & 0xFF);
+		reg<addrs::NR14>() = static_cast<uint8_t>((reg<addrs::NR14>() & ~7) | (new_freq >> 8));
+		calc_sweep();
+	}
+}
+
+void APU::clock_frame_sequencer() {
+	using namespace addrs;
+	// step: 0 1 2 3 4 5 6 7
+	// len:  x   x   x   x
+	// sweep:    x       x
+	// env:                x
+	if(!(frame_sequencer_step & 1)) {
+		pulse[0].clock_length(reg<NR14>());
+		pulse[1].clock_length(reg<NR24>());
+		wave.clock_length(reg<NR34>());
+		noise.clock_length(reg<NR44>());
+	}
+	if(frame_sequencer_step == 2 || frame_sequencer_step == 6) clock_sweep();
+	if(frame_sequencer_step == 7) {
+		pulse[0].env.clock(reg<NR12>());
+		pulse[1].env.clock(reg<NR22>());
+		noise.env.clock(reg<NR42>());
+	}
+	frame_sequencer_step = static_cast<uint8_t>((frame_sequencer_step + 1) & 7);
+}
+
+void APU::step_pulse(unsigned i, uint64_t steps) {
+	auto& ch = pulse[i];
+	ch.duty_pos = static_cast<uint8_t>((ch.duty_pos + steps) & 7);
+	ch.next_clock += steps * ((2048 - pulse_freq(i)) * 4);
+}
+
+void APU::step_wave(uint64_t steps) {
+	wave.pos = static_cast<uint8_t>((wave.pos + steps) & 31);
+	wave.sample = static_cast<uint8_t>((wave_table[wave.pos >> 1] >> ((~wave.pos & 1) * 4)) & 0xF);
+	wave.next_clock += steps * ((2048 - wave_freq()) * 2);
+}
+
+void APU::step_noise(uint64_t steps) {
+	noise.next_clock += steps * noise_period();
+	noise.lfsr_pending += steps;
+	if(noise.stepping) flush_lfsr();
+}
+
+void APU::flush_lfsr() {
+	const bool short_mode = get_bit(reg<addrs::NR43>(), 3);
+	// the LFSR repeats every 32767 shifts (127 in 7 bit mode, once the old top bits have been shifted out),
+	// so a long catch up only has to do the last partial period.
+	constexpr uint64_t WARMUP = 16;
+	auto shifts = noise.lfsr_pending;
+	if(shifts > WARMUP) shifts = WARMUP + (shifts - WARMUP) % (short_mode ? 127 : 32767);
+	noise.lfsr_pending = 0;
+	for(; shifts; --shifts) {
+		const uint16_t feedback = (noise.lfsr ^ (noise.lfsr >> 1)) & 1;
+		noise.lfsr = static_cast<uint16_t>((noise.lfsr >> 1) | (feedback << 14));
+		if(short_mode) noise.lfsr = static_cast<uint16_t>((noise.lfsr & ~(1 << 6)) | (feedback << 6));
+	}
+}
+
+void APU::catch_up(uint64_t until) {
+	// closed form: all of a channel's timer events before until at once.
+	const auto events_before = [until](const channel& ch, uint64_t period) -> uint64_t {
+		if(ch.stepping || ch.next_clock >= until) return 0;
+		return (until - 1 - ch.next_clock) / period + 1;
+	};
+	for(unsigned i = 0; i < pulse.size(); ++i) {
+		if(const auto steps = events_before(pulse[i], (2048 - pulse_freq(i)) * 4)) step_pulse(i, steps);
+	}
+	if(const auto steps = events_before(wave, (2048 - wave_freq()) * 2)) step_wave(steps);
+	if(const auto steps = events_before(noise, noise_period())) step_noise(steps);
+}
+
+void APU::update_stepping() {
+	using namespace addrs;
+	// a channel only has to be stepped event by event if where it is in its waveform changes the output.
+	const uint8_t nr51 = reg<NR51>();
+	const auto audible = [&](const channel& ch, unsigned i, bool dac_on) {
+		return producing_output() && ch.enabled && dac_on && ((nr51 >> i) & 0x11);
+	};
+	for(unsigned i = 0; i < pulse.size(); ++i) {
+		auto& ch = pulse[i];
+		if(!ch.enabled) ch.next_clock = NEVER; // disabled channels stop their timers
+		ch.stepping = audible(ch, i, reg(pulse_regs(i) + 2) & 0xF8) && ch.env.volume;
+	}
+	if(!wave.enabled) wave.next_clock = NEVER;
+	wave.stepping = audible(wave, 2, get_bit(reg<NR30>(), 7)) && (reg<NR32>() & 0x60);
+	if(!noise.enabled) noise.next_clock = NEVER;
+	noise.stepping = audible(noise, 3, reg<NR42>() & 0xF8) && noise.env.volume;
+	if(noise.stepping) flush_lfsr();
+}
+
+void APU::set_output_enabled(bool enabled) {
+	catch_up(now);
+	output_enabled = enabled;
+	blip.clear(now);
+	resampler.clear();
+	output_l = output_r = 0;
+	update_stepping();
+	update_output();
+}
+
+void APU::pause_output() {
+	catch_up(now);
+	output_paused = true;
+	update_stepping();
+}
+
+void APU::resume_output() {
+	output_paused = false;
+	catch_up(now);
+	blip.set_clock(now);
+	update_stepping();
+	update_output();
+}
+
+void APU::run_until(uint64_t clock) {
+	if(clock <= now) return;
+	while(true) {
+		uint64_t next = frame_sequencer_next;
+		for(const auto* ch : std::initializer_list<const channel*>{&pulse[0], &pulse[1], &wave, &noise}) {
+			if(ch->stepping) next = std::min(next, ch->next_clock);
+		}
+		if(next >= clock) break;
+		now = next;
+
+		if(frame_sequencer_next == now) {
+			catch_up(now); // the frame sequencer can make a channel audible
+			clock_frame_sequencer();
+			frame_sequencer_next += FRAME_SEQUENCER_TCLKS;
+			update_stepping();
+		}
+		for(unsigned i = 0; i < pulse.size(); ++i) {
+			if(pulse[i].stepping && pulse[i].next_clock == now) step_pulse(i, 1);
+		}
+		if(wave.stepping && wave.next_clock == now) step_wave(1);
+		if(noise.stepping && noise.next_clock == now) step_noise(1);
+		update_output();
+	}
+	catch_up(clock);
+	now = clock;
+	if(producing_output()) blip.end_frame(now);
+}
+
+void APU::sync(uint64_t clock) {
+	run_until(clock);
+	flush_lfsr();
+}
+
+void APU::load_state(StateReader& io) {
+	serialize(*this, io);
+	for(auto* ch : std::initializer_list<channel*>{&pulse[0], &pulse[1], &wave, &noise}) ch->stepping = false;
+	blip.set_clock(now);
+	update_stepping();
+	update_output();
+}
+
+size_t APU::samples_available() const {
+	return resampler.samples_available() + static_cast<size_t>(static_cast<double>(blip.samples_available()) * resampler.out_rate() / INTERNAL_SAMPLE_RATE);
+}
+
+size_t APU::read_samples(std::span<int16_t> out) {
+	// feed the resampler in blocks, only as much as this read needs.
+	std::array<int16_t, 2 * 1024> block;
+	for(size_t needed = resampler.input_needed(out.size() / 2); needed;) {
+		const size_t got = blip.read_samples(std::span{block}.first(2 * std::min(needed, block.size() / 2)));
+		if(!got) break;
+		resampler.write(std::span{block}.first(2 * got));
+		needed -= std::min(needed, got);
+	}
+	return resampler.read_samples(out);
+}
+
+void APU::update_output() {
+	using namespace addrs;
+	if(!producing_output()) return;
+	// DAC output for each channel, -15 to 15, or 0 if the DAC is off.
+	// NOTE: the channel's digital output is 0 while it's disabled, even though the DAC may still be on.
+	std::array<int32_t, 4> dac{};
+	for(unsigned i = 0; i < pulse.size(); ++i) {
+		if(!(reg(pulse_regs(i) + 2) & 0xF8)) continue;
+		const auto& ch = pulse[i];
+		const uint8_t duty = reg(pulse_regs(i) + 1) >> 6;
+		const int32_t digital = ch.enabled && ((PULSE_DUTY_CYCLES[duty] >> ch.duty_pos) & 1) ? ch.env.volume : 0;
+		dac[i] = digital * 2 - 15;
+	}
+	if(get_bit(reg<NR30>(), 7)) {
+		constexpr std::array<uint8_t, 4> WAVE_SHIFTS{4, 0, 1, 2};
+		const int32_t digital = wave.enabled ? wave.sample >> WAVE_SHIFTS[(reg<NR32>() >> 5) & 3] : 0;
+		dac[2] = digital * 2 - 15;
+	}
+	if(reg<NR42>() & 0xF8) {
+		const int32_t digital = noise.enabled && !(noise.lfsr & 1) ? noise.env.volume : 0;
+		dac[3] = digital * 2 - 15;
+	}
+
+	const uint8_t nr50 = reg<NR50>(), nr51 = reg<NR51>();
+	int32_t left = 0, right = 0;
+	for(unsigned i = 0; i < dac.size(); ++i) {
+		if(get_bit(nr51, static_cast<uint8_t>(i + 4))) left += dac[i];
+		if(get_bit(nr51, static_cast<uint8_t>(i))) right += dac[i];
+	}
+	left *= (((nr50 >> 4) & 7) + 1) * OUTPUT_SCALE;
+	right *= ((nr50 & 7) + 1) * OUTPUT_SCALE;
+	if(left != output_l || right != output_r) {
+		blip.add_delta(now, left - output_l, right - output_r);
+		output_l = left;
+		output_r = right;
+	}
+}
+
+}
@@ -0,0 +1,148 @@
+#include <gb/apu/blip_buffer.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+
+namespace gb::apu {
+
+namespace {
+
+constexpr int KERNEL_WIDTH = 16; // samples each step is spread over
+constexpr int PHASE_BITS = 6;
+constexpr int PHASES = 1 << PHASE_BITS; // sub-sample positions a step can start at
+constexpr int KERNEL_BITS = 15; // each kernel row sums to 1 << KERNEL_BITS
+
+using kernel_row = std::array<int32_t, KERNEL_WIDTH>;
+
+// impulse responses for a step at each sub-sample phase:
+// blackman windowed sinc, cut off a bit below nyquist so there's room for the transition band.
+const std::array<kernel_row, PHASES>& kernel() {
+	static const auto table = []{
+		std::array<kernel_row, PHASES> ret;
+		constexpr double CUTOFF = 0.9;
+		constexpr double HALF = KERNEL_WIDTH / 2.0;
+		for(int phase = 0; phase < PHASES; ++phase) {
+			std::array<double, KERNEL_WIDTH> taps;
+			double sum = 0;
+			for(int i = 0; i < KERNEL_WIDTH; ++i) {
+				const double t = (i - (HALF - 1)) - static_cast<double>(phase) / PHASES; // distance from the step
+				const double x = std::numbers::pi * CUTOFF * t;
+				const double sinc = x == 0 ? 1 : std::sin(x) / x;
+				const double window = 0.42 + 0.5 * std::cos(std::numbers::pi * t / HALF) + 0.08 * std::cos(2 * std::numbers::pi * t / HALF);
+				taps[i] = std::abs(t) >= HALF ? 0 : sinc * window;
+				sum += taps[i];
+			}
+			// normalize, putting the rounding error on the largest tap so each row sums exactly to 1 << KERNEL_BITS
+			int32_t total = 0;
+			for(int i = 0; i < KERNEL_WIDTH; ++i) {
+				ret[phase][i] = static_cast<int32_t>(std::lround(taps[i] / sum * (1 << KERNEL_BITS)));
+				total += ret[phase][i];
+			}
+			const auto peak = std::max_element(ret[phase].begin(), ret[phase].end());
+			*peak += (1 << KERNEL_BITS) - total;
+		}
+		return ret;
+	}();
+	return table;
+}
+
+}
+
+BlipBuffer::BlipBuffer(double clock_rate, double sample_rate) {
+	set_rates(clock_rate, sample_rate);
+}
+
+void BlipBuffer::set_rates(double clock_rate, double sample_rate) {
+	clock_rate_ = clock_rate;
+	sample_rate_ = sample_rate;
+	factor = static_cast<uint64_t>(std::llround(sample_rate / clock_rate * static_cast<double>(1ULL << FRAC_BITS)));
+	// DMG high pass filter: the capacitor charge factor is 0.999958 per tclk (see apu.h), applied per output sample here.
+	high_pass_charge = static_cast<float>(std::pow(0.999958, clock_rate / sample_rate));
+	clear(frame_clock);
+}
+
+void BlipBuffer::clear(uint64_t clock) {
+	frame_clock = clock;
+	frame_pos = 0;
+	buf_l.assign(KERNEL_WIDTH, 0);
+	buf_r.assign(KERNEL_WIDTH, 0);
+	used_end = KERNEL_WIDTH;
+	sum_l = sum_r = 0;
+	capacitor_l = capacitor_r = 0;
+}
+
+void BlipBuffer::add_delta(uint64_t clock, int32_t delta_l, int32_t delta_r) {
+	const uint64_t pos = frame_pos + (clock - frame_clock) * factor;
+	const size_t idx = static_cast<size_t>(pos >> FRAC_BITS);
+	const auto& row = kernel()[(pos >> (FRAC_BITS - PHASE_BITS)) & (PHASES - 1)];
+	if(idx + KERNEL_WIDTH > buf_l.size()) {
+		buf_l.resize(idx + KERNEL_WIDTH, 0);
+		buf_r.resize(idx + KERNEL_WIDTH, 0);
+	}
+	used_end = std::max(used_end, idx + KERNEL_WIDTH);
+	int64_t* l = buf_l.data() + idx;
+	int64_t* r = buf_r.data() + idx;
+	for(int i = 0; i < KERNEL_WIDTH; ++i) {
+		l[i] += static_cast<int64_t>(row[i]) * delta_l;
+		r[i] += static_cast<int64_t>(row[i]) * delta_r;
+	}
+}
+
+void BlipBuffer::end_frame(uint64_t clock) {
+	frame_pos += (clock - frame_clock) * factor;
+	frame_clock = clock;
+	used_end = std::max(used_end, samples_available() + KERNEL_WIDTH);
+	if(used_end > buf_l.size()) {
+		buf_l.resize(used_end, 0);
+		buf_r.resize(used_end, 0);
+	}
+	// drop down to half full, so a reader that's gone away doesn't cost a buffer shift every frame.
+	const auto max_samples = static_cast<size_t>(sample_rate_ * MAX_BUFFERED_SECONDS);
+	if(samples_available() > max_samples) skip_samples(samples_available() - max_samples / 2);
+}
+
+void BlipBuffer::integrate(size_t count, int16_t* out) {
+	constexpr float SCALE = 1.0f / (1 << KERNEL_BITS);
+	for(size_t i = 0; i < count; ++i) {
+		sum_l += buf_l[i];
+		sum_r += buf_r[i];
+		// high pass: out = in - capacitor, capacitor = in - out * charge
+		const float in_l = static_cast<float>(sum_l) * SCALE;
+		const float in_r = static_cast<float>(sum_r) * SCALE;
+		const float out_l = in_l - capacitor_l;
+		const float out_r = in_r - capacitor_r;
+		capacitor_l = in_l - out_l * high_pass_charge;
+		capacitor_r = in_r - out_r * high_pass_charge;
+		if(out) {
+			*out++ = static_cast<int16_t>(std::clamp(std::lround(out_l), -32768L, 32767L));
+			*out++ = static_cast<int16_t>(std::clamp(std::lround(out_r), -32768L, 32767L));
+		}
+	}
+}
+
+size_t BlipBuffer::read_samples(std::span<int16_t> out) {
+	const size_t count = std::min(samples_available(), out.size() / 2);
+	integrate(count, out.data());
+	remove_samples(count);
+	return count;
+}
+
+void BlipBuffer::skip_samples(size_t count) {
+	count = std::min(count, samples_available());
+	integrate(count, nullptr);
+	remove_samples(count);
+}
+
+void BlipBuffer::remove_samples(size_t count) {
+	// keep the tail: deltas near the end of the frame reach up to KERNEL_WIDTH samples past it.
+	std::copy(buf_l.begin() + count, buf_l.begin() + used_end, buf_l.begin());
+	std::copy(buf_r.begin() + count, buf_r.begin() + used_end, buf_r.begin());
+	std::fill(buf_l.begin() + (used_end - count), buf_l.begin() + used_end, 0);
+	std::fill(buf_r.begin() + (used_end - count), buf_r.begin() + used_end, 0);
+	used_end -= count;
+	frame_pos -= static_cast<uint64_t>(count) << FRAC_BITS;
+}
+
+}
@@ -0,0 +1,197 @@
+#include <gb/apu/resampler.h>
+#include <gb/utils/log.h>
+#include <gb/utils/simd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+
+namespace gb::apu {
+
+namespace {
+
+// each kernel produces one output sample per channel: sum over taps of input * (coef + frac * delta).
+// delta (the difference to the next phase's coefficients) is stored right after coef.
+
+void kernel_scalar(const float* l, const float* r, const float* coef, unsigned taps, float frac, float& out_l, float& out_r) {
+	const float* delta = coef + taps;
+	float sum_l = 0, sum_r = 0;
+	for(unsigned i = 0; i < taps; ++i) {
+		const float c = coef[i] + frac * delta[i];
+		sum_l += l[i] * c;
+		sum_r += r[i] * c;
+	}
+	out_l = sum_l;
+	out_r = sum_r;
+}
+
+#if GB_SIMD_SSE2
+float hsum(__m128 x) {
+	x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+	x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+	return _mm_cvtss_f32(x);
+}
+
+void kernel_sse2(const float* l, const float* r, const float* coef, unsigned taps, float frac, float& out_l, float& out_r) {
+	const float* delta = coef + taps;
+	const __m128 f = _mm_set1_ps(frac);
+	__m128 sum_l = _mm_setzero_ps(), sum_r = _mm_setzero_ps();
+	for(unsigned i = 0; i < taps; i += 4) {
+		const __m128 c = _mm_add_ps(_mm_loadu_ps(coef + i), _mm_mul_ps(f, _mm_loadu_ps(delta + i)));
+		sum_l = _mm_add_ps(sum_l, _mm_mul_ps(_mm_loadu_ps(l + i), c));
+		sum_r = _mm_add_ps(sum_r, _mm_mul_ps(_mm_loadu_ps(r + i), c));
+	}
+	out_l = hsum(sum_l);
+	out_r = hsum(sum_r);
+}
+#endif
+
+#if GB_SIMD_AVX2
+GB_TARGET_AVX2 void kernel_avx2(const float* l, const float* r, const float* coef, unsigned taps, float frac, float& out_l, float& out_r) {
+	const float* delta = coef + taps;
+	const __m256 f = _mm256_set1_ps(frac);
+	__m256 sum_l = _mm256_setzero_ps(), sum_r = _mm256_setzero_ps();
+	for(unsigned i = 0; i < taps; i += 8) {
+		const __m256 c = _mm256_fmadd_ps(f, _mm256_loadu_ps(delta + i), _mm256_loadu_ps(coef + i));
+		sum_l = _mm256_fmadd_ps(_mm256_loadu_ps(l + i), c, sum_l);
+		sum_r = _mm256_fmadd_ps(_mm256_loadu_ps(r + i), c, sum_r);
+	}
+	// l and r sums in one register each, fold halves then horizontal add
+	const __m128 l4 = _mm_add_ps(_mm256_castps256_ps128(sum_l), _mm256_extractf128_ps(sum_l, 1));
+	const __m128 r4 = _mm_add_ps(_mm256_castps256_ps128(sum_r), _mm256_extractf128_ps(sum_r, 1));
+	const __m128 lr = _mm_hadd_ps(_mm_hadd_ps(l4, r4), _mm_setzero_ps()); // [l, r, 0, 0]
+	out_l = _mm_cvtss_f32(lr);
+	out_r = _mm_cvtss_f32(_mm_shuffle_ps(lr, lr, 1));
+}
+#endif
+
+}
+
+Resampler::Resampler(double in_rate, double out_rate) {
+	kernel = kernel_scalar;
+#if GB_SIMD_SSE2
+	kernel = kernel_sse2;
+#endif
+#if GB_SIMD_AVX2
+	if(simd::cpu_has_avx2()) kernel = kernel_avx2;
+#endif
+	set_rates(in_rate, out_rate);
+	clear();
+}
+
+void Resampler::set_rates(double in_rate, double out_rate) {
+	if(in_rate <= 0 || out_rate <= 0) throw_exc("Bad resampling rates {} -> {}", in_rate, out_rate);
+	in_rate_ = in_rate;
+	out_rate_ = out_rate;
+	step = static_cast<uint64_t>(std::llround(in_rate / out_rate * static_cast<double>(1ULL << FRAC_BITS)));
+
+	// cut off a bit below the lower of the two nyquist rates, leaving room for the transition band.
+	const double cutoff = 0.9 * std::min(1.0, out_rate / in_rate);
+	if(std::abs(cutoff - cutoff_) <= 0.01 * cutoff) return;
+
+	// keep the center of the filter (the current output position) where it is.
+	const unsigned old_taps = taps;
+	build_filter(cutoff);
+	if(old_taps == 0) return;
+	if(taps < old_taps) {
+		pos += static_cast<uint64_t>((old_taps - taps) / 2) << FRAC_BITS;
+	} else if(const uint64_t grow = (taps - old_taps) / 2; grow) {
+		const uint64_t start = pos >> FRAC_BITS;
+		if(start < grow) { // not enough history, pad with silence
+			buf_l.insert(buf_l.begin(), grow - start, 0.f);
+			buf_r.insert(buf_r.begin(), grow - start, 0.f);
+			pos += (grow - start) << FRAC_BITS;
+		}
+		pos -= grow << FRAC_BITS;
+	}
+}
+
+void Resampler::build_filter(double cutoff) {
+	cutoff_ = cutoff;
+	const double width = std::ceil(BASE_TAPS * 0.9 / cutoff / 8) * 8;
+	taps = std::min(MAX_TAPS, static_cast<unsigned>(width));
+	const double half = taps / 2.0;
+
+	// rows for phases 0 to PHASES (inclusive, so the last phase has something to interpolate towards).
+	std::vector<std::vector<double>> rows(PHASES + 1, std::vector<double>(taps));
+	for(unsigned phase = 0; phase <= PHASES; ++phase) {
+		double sum = 0;
+		for(unsigned i = 0; i < taps; ++i) {
+			// distance (in input samples) from tap i to the output sample, which sits between taps half-1 and half.
+			const double t = (half - 1) + static_cast<double>(phase) / PHASES - i;
+			const double x = std::numbers::pi * cutoff * t;
+			const double sinc = x == 0 ? 1 : std::sin(x) / x;
+			const double window = 0.42 + 0.5 * std::cos(std::numbers::pi * t / half) + 0.08 * std::cos(2 * std::numbers::pi * t / half);
+			rows[phase][i] = std::abs(t) >= half ? 0 : sinc * window;
+			sum += rows[phase][i];
+		}
+		for(auto& tap : rows[phase]) tap /= sum; // unity gain at DC
+	}
+	filter.resize(size_t{PHASES} * 2 * taps);
+	for(unsigned phase = 0; phase < PHASES; ++phase) {
+		float* coef = &filter[size_t{phase} * 2 * taps];
+		for(unsigned i = 0; i < taps; ++i) {
+			coef[i] = static_cast<float>(rows[phase][i]);
+			coef[taps + i] = static_cast<float>(rows[phase + 1][i] - rows[phase][i]);
+		}
+	}
+}
+
+void Resampler::clear() {
+	// the first input sample lines up with the first output sample.
+	buf_l.assign(taps / 2 - 1, 0.f);
+	buf_r.assign(taps / 2 - 1, 0.f);
+	pos = 0;
+}
+
+void Resampler::write(std::span<const int16_t> in) {
+	const size_t old_size = buf_l.size();
+	const size_t count = in.size() / 2;
+	buf_l.resize(old_size + count);
+	buf_r.resize(old_size + count);
+	float* l = buf_l.data() + old_size;
+	float* r = buf_r.data() + old_size;
+	for(size_t i = 0; i < count; ++i) {
+		l[i] = in[2 * i];
+		r[i] = in[2 * i + 1];
+	}
+}
+
+size_t Resampler::samples_available() const {
+	// output k is possible while its first tap plus taps fits in the buffer
+	if(buf_l.size() < taps) return 0;
+	const uint64_t limit = static_cast<uint64_t>(buf_l.size() - taps + 1) << FRAC_BITS;
+	return pos < limit ? static_cast<size_t>((limit - 1 - pos) / step + 1) : 0;
+}
+
+size_t Resampler::input_needed(size_t out_samples) const {
+	if(!out_samples) return 0;
+	const uint64_t last = pos + (samples_available() + out_samples - 1) * step;
+	const size_t needed = static_cast<size_t>(last >> FRAC_BITS) + taps;
+	return needed > buf_l.size() ? needed - buf_l.size() : 0;
+}
+
+size_t Resampler::read_samples(std::span<int16_t> out) {
+	const size_t count = std::min(out.size() / 2, samples_available());
+	constexpr unsigned SUB_BITS = FRAC_BITS - std::bit_width(PHASES - 1);
+	constexpr float SUB_SCALE = 1.f / (1u << SUB_BITS);
+	const auto to_int16 = [](float x) { return static_cast<int16_t>(std::lrint(std::clamp(x, -32768.f, 32767.f))); };
+	for(size_t i = 0; i < count; ++i, pos += step) {
+		const size_t idx = static_cast<size_t>(pos >> FRAC_BITS);
+		const uint32_t frac = static_cast<uint32_t>(pos);
+		const float* coef = &filter[size_t{frac >> SUB_BITS} * 2 * taps];
+		float l, r;
+		kernel(&buf_l[idx], &buf_r[idx], coef, taps, static_cast<float>(frac & ((1u << SUB_BITS) - 1)) * SUB_SCALE, l, r);
+		out[2 * i] = to_int16(l);
+		out[2 * i + 1] = to_int16(r);
+	}
+	// drop input nothing will look at again
+	const size_t consumed = static_cast<size_t>(pos >> FRAC_BITS);
+	buf_l.erase(buf_l.begin(), buf_l.begin() + static_cast<ptrdiff_t>(consumed));
+	buf_r.erase(buf_r.begin(), buf_r.begin() + static_cast<ptrdiff_t>(consumed));
+	pos -= static_cast<uint64_t>(consumed) << FRAC_BITS;
+	return count;
+}
+
+}
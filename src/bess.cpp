@@ -0,0 +1,229 @@
+#include <gb/bess.h>
+#include <gb/memory/memory_map.h>
+#include <gb/utils/log.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+namespace gb::bess {
+
+namespace {
+
+// everything in BESS is little endian
+void put_u16(std::vector<uint8_t>& out, uint16_t value) {
+	out.push_back(static_cast<uint8_t>(value));
+	out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+	put_u16(out, static_cast<uint16_t>(value));
+	put_u16(out, static_cast<uint16_t>(value >> 16));
+}
+
+uint16_t get_u16(std::span<const uint8_t> in, size_t pos) {
+	return static_cast<uint16_t>(in[pos] | (in[pos + 1] << 8));
+}
+
+uint32_t get_u32(std::span<const uint8_t> in, size_t pos) {
+	return get_u16(in, pos) | (static_cast<uint32_t>(get_u16(in, pos + 2)) << 16);
+}
+
+void put_block_header(std::vector<uint8_t>& out, std::string_view id, uint32_t length) {
+	out.insert(out.end(), id.begin(), id.end());
+	put_u32(out, length);
+}
+
+constexpr std::string_view NAME = "gbc-emulator";
+constexpr std::string_view FOOTER_MAGIC = "BESS";
+
+// CORE block layout (v1.1)
+constexpr uint32_t CORE_LENGTH = 0xD0;
+constexpr size_t CORE_MODEL = 0x04, CORE_REGS = 0x08, CORE_IME = 0x14, CORE_IE = 0x15, CORE_EXEC_STATE = 0x16;
+constexpr size_t CORE_IO_REGS = 0x18;
+// size/offset pairs of the buffers outside the blocks
+constexpr size_t CORE_RAM = 0x98, CORE_VRAM = 0xA0, CORE_MBC_RAM = 0xA8, CORE_OAM = 0xB0, CORE_HRAM = 0xB8;
+constexpr uint8_t EXEC_RUNNING = 0, EXEC_HALTED = 1;
+
+constexpr uint32_t INFO_LENGTH = 0x12; // title, then global checksum
+
+constexpr std::array<uint16_t, 4> CHANNEL_NRX4{apu::addrs::NR14, apu::addrs::NR24, apu::addrs::NR34, apu::addrs::NR44};
+
+}
+
+std::vector<uint8_t> export_state(gameboy_emulator& emulator) {
+	using namespace memory::addrs;
+	using namespace apu::addrs;
+	std::vector<uint8_t> out = emulator.save_state(); // also syncs the APU
+	const auto& mmu = emulator.mmu;
+	const auto& cartridge = mmu.get_cartridge();
+	const auto high_mem = mmu.raw_high_mem();
+
+	std::vector<uint8_t> core;
+	core.reserve(CORE_LENGTH);
+	put_u16(core, 1); // major
+	put_u16(core, 1); // minor
+	core.insert(core.end(), {'G', 'D', 'B', ' '}); // DMG-B
+	const auto regs = emulator.cpu.get_registers();
+	for(const uint16_t r : {regs.pc, regs.af, regs.bc, regs.de, regs.hl, regs.sp}) put_u16(core, r);
+	core.push_back(regs.ime);
+	core.push_back(high_mem[INTERRUPT_ENABLE - IO_MMAP_BEGIN]);
+	core.push_back(regs.halted ? EXEC_HALTED : EXEC_RUNNING);
+	core.push_back(0);
+	for(uint16_t addr = IO_MMAP_BEGIN; addr < IO_MMAP_END; ++addr) {
+		// registers as last written. NR52's channel bits only exist on read.
+		if(addr == NR52) core.push_back(emulator.apu.read(addr));
+		else if(addr >= AUDIOS_BEGIN && addr < AUDIOS_END) core.push_back(emulator.apu.peek(addr));
+		else core.push_back(high_mem[addr - IO_MMAP_BEGIN]);
+	}
+	const auto put_buffer = [&](std::span<const uint8_t> data) {
+		put_u32(core, static_cast<uint32_t>(data.size()));
+		put_u32(core, data.empty() ? 0 : static_cast<uint32_t>(out.size()));
+		out.insert(out.end(), data.begin(), data.end());
+	};
+	put_buffer(mmu.raw_wram());
+	put_buffer(mmu.raw_vram());
+	put_buffer(cartridge.raw_ram());
+	put_buffer(mmu.raw_oam());
+	put_buffer(high_mem.subspan(HRAM_BEGIN - IO_MMAP_BEGIN, HRAM_END - HRAM_BEGIN));
+	put_buffer({}); // no palettes on DMG
+	put_buffer({});
+	if(core.size() != CORE_LENGTH) throw_exc("CORE block is {} bytes", core.size());
+
+	const auto first_block = static_cast<uint32_t>(out.size());
+	put_block_header(out, "NAME", static_cast<uint32_t>(NAME.size()));
+	out.insert(out.end(), NAME.begin(), NAME.end());
+
+	put_block_header(out, "CORE", CORE_LENGTH);
+	out.insert(out.end(), core.begin(), core.end());
+
+	put_block_header(out, "INFO", INFO_LENGTH);
+	for(uint16_t addr = TITLE_BEGIN; addr < TITLE_BEGIN + 0x10; ++addr) out.push_back(cartridge.read(addr));
+	out.push_back(cartridge.read(GLOBAL_CHECKSUM));
+	out.push_back(cartridge.read(GLOBAL_CHECKSUM + 1));
+
+	if(const auto writes = cartridge.register_writes(); !writes.empty()) {
+		put_block_header(out, "MBC ", static_cast<uint32_t>(3 * writes.size()));
+		for(const auto& [addr, value] : writes) {
+			put_u16(out, addr);
+			out.push_back(value);
+		}
+	}
+
+	put_block_header(out, "END ", 0);
+	put_u32(out, first_block);
+	out.insert(out.end(), FOOTER_MAGIC.begin(), FOOTER_MAGIC.end());
+	return out;
+}
+
+void import_state(gameboy_emulator& emulator, std::span<const uint8_t> data) {
+	using namespace memory::addrs;
+	using namespace apu::addrs;
+	if(data.size() < 8 || std::string_view{reinterpret_cast<const char*>(data.data() + data.size() - 4), 4} != FOOTER_MAGIC) {
+		throw_exc("Not a BESS save state");
+	}
+	if(const auto native_size = emulator.state_size(); data.size() >= native_size && emulator.can_load_state(data.first(native_size))) {
+		emulator.load_state(data.first(native_size));
+		return;
+	}
+
+	// find everything, and check it, before changing anything
+	std::optional<std::span<const uint8_t>> core;
+	std::span<const uint8_t> mbc_writes;
+	auto& cartridge = emulator.mmu.get_cartridge();
+	for(size_t pos = get_u32(data, data.size() - 8);;) {
+		if(pos + 8 > data.size() - 8) throw_exc("BESS blocks run past the end of the file");
+		const std::string_view id{reinterpret_cast<const char*>(data.data() + pos), 4};
+		const uint32_t length = get_u32(data, pos + 4);
+		pos += 8;
+		if(length > data.size() - 8 - pos) throw_exc("BESS block {} of {} bytes runs past the end of the file", id, length);
+		const auto block = data.subspan(pos, length);
+		pos += length;
+		if(id == "END ") break;
+		if(id == "NAME") {
+			log_info("Importing BESS save state from {}", std::string_view{reinterpret_cast<const char*>(block.data()), block.size()});
+		} else if(id == "CORE") {
+			if(length < CORE_LENGTH || get_u16(block, 0) != 1) throw_exc("Unsupported BESS CORE block, version {}", get_u16(block, 0));
+			core = block;
+		} else if(id == "INFO") {
+			if(length < INFO_LENGTH) throw_exc("BESS INFO block too short");
+			if(block[0x10] != cartridge.read(GLOBAL_CHECKSUM) || block[0x11] != cartridge.read(GLOBAL_CHECKSUM + 1)) {
+				throw_exc("Save state is for a different cartridge");
+			}
+		} else if(id == "MBC ") {
+			mbc_writes = block;
+		} else {
+			log_debug("Skipping BESS block {}", id);
+		}
+	}
+	if(!core) throw_exc("BESS save state has no CORE block");
+	if((*core)[CORE_MODEL] != 'G' || (*core)[CORE_MODEL + 1] != 'D') {
+		throw_exc("Save state is for model {}, only DMG is supported", std::string_view{reinterpret_cast<const char*>(core->data() + CORE_MODEL), 4});
+	}
+
+	const auto buffer = [&](size_t entry, size_t expected_size, std::string_view name) {
+		const uint32_t size = get_u32(*core, entry);
+		const uint32_t offset = get_u32(*core, entry + 4);
+		if(size != expected_size) throw_exc("BESS {} is {} bytes, expected {}", name, size, expected_size);
+		if(offset > data.size() || size > data.size() - offset) throw_exc("BESS {} runs past the end of the file", name);
+		return data.subspan(offset, size);
+	};
+	auto& mmu = emulator.mmu;
+	const auto wram = buffer(CORE_RAM, mmu.raw_wram().size(), "RAM");
+	const auto vram = buffer(CORE_VRAM, mmu.raw_vram().size(), "VRAM");
+	const auto mbc_ram = buffer(CORE_MBC_RAM, cartridge.raw_ram().size(), "MBC RAM");
+	const auto oam = buffer(CORE_OAM, mmu.raw_oam().size(), "OAM");
+	const auto hram = buffer(CORE_HRAM, HRAM_END - HRAM_BEGIN, "HRAM");
+	const auto io_regs = core->subspan(CORE_IO_REGS, IO_MMAP_END - IO_MMAP_BEGIN);
+	const auto io_reg = [&io_regs](uint16_t addr) { return io_regs[addr - IO_MMAP_BEGIN]; };
+
+	emulator.cpu.set_registers({
+		.af = get_u16(*core, CORE_REGS + 2),
+		.bc = get_u16(*core, CORE_REGS + 4),
+		.de = get_u16(*core, CORE_REGS + 6),
+		.hl = get_u16(*core, CORE_REGS + 8),
+		.sp = get_u16(*core, CORE_REGS + 10),
+		.pc = get_u16(*core, CORE_REGS),
+		.ime = (*core)[CORE_IME] != 0,
+		.halted = (*core)[CORE_EXEC_STATE] == EXEC_HALTED,
+	});
+
+	std::ranges::copy(wram, mmu.raw_wram().begin());
+	std::ranges::copy(vram, mmu.raw_vram().begin());
+	std::ranges::copy(oam, mmu.raw_oam().begin());
+	const auto high_mem = mmu.raw_high_mem();
+	for(uint16_t addr = IO_MMAP_BEGIN; addr < IO_MMAP_END; ++addr) {
+		if(addr < AUDIOS_BEGIN || addr >= AUDIOS_END) high_mem[addr - IO_MMAP_BEGIN] = io_reg(addr);
+	}
+	std::ranges::copy(hram, high_mem.begin() + (HRAM_BEGIN - IO_MMAP_BEGIN));
+	high_mem[INTERRUPT_ENABLE - IO_MMAP_BEGIN] = (*core)[CORE_IE];
+	mmu.set_boot_rom_enabled(io_reg(BOOT_ROM_SELECT) == 0);
+	mmu.cancel_transfers();
+
+	for(size_t i = 0; i + 3 <= mbc_writes.size(); i += 3) cartridge.write(get_u16(mbc_writes, i), mbc_writes[i + 2]);
+	std::ranges::copy(mbc_ram, cartridge.raw_ram().begin());
+
+	// audio goes through the registers from power off, without triggering anything,
+	// then the channels that were playing are started over.
+	auto& apu = emulator.apu;
+	apu.sync(emulator.total_tclks);
+	apu.reset();
+	apu.set_div(emulator.total_tclks, io_reg(DIVIDER));
+	for(uint16_t addr = WAVETABLE_RAM_BEGIN; addr < WAVETABLE_RAM_END; ++addr) apu.write(addr, io_reg(addr));
+	if(const auto nr52 = io_reg(NR52); get_bit(nr52, 7)) {
+		apu.write(NR52, 0x80);
+		for(uint16_t addr = NR10; addr < NR52; ++addr) {
+			const bool nrx4 = std::ranges::find(CHANNEL_NRX4, addr) != CHANNEL_NRX4.end();
+			apu.write(addr, nrx4 ? static_cast<uint8_t>(io_reg(addr) & 0x7F) : io_reg(addr));
+		}
+		for(unsigned i = 0; i < CHANNEL_NRX4.size(); ++i) {
+			if(get_bit(nr52, static_cast<uint8_t>(i))) apu.write(CHANNEL_NRX4[i], io_reg(CHANNEL_NRX4[i]) | 0x80);
+		}
+	}
+
+	emulator.ppu.restart_line();
+}
+
+}
@@ -0,0 +1,112 @@
+#include <gb/boot.h>
+#include <gb/gb.h>
+#include <gb/memory/memory_map.h>
+#include <gb/utils/bitops.h>
+#include <gb/utils/load_file.h>
+
+#include <array>
+#include <filesystem>
+#include <utility>
+
+namespace gb {
+
+namespace {
+
+struct reg_value {
+	uint16_t addr;
+	uint8_t value;
+};
+
+// the DMG's registers after its boot ROM, from https://gbdev.io/pandocs/Power_Up_Sequence.html.
+// STAT's mode and the PPU's timing come from starting the line over (see PPU::restart_line()).
+constexpr auto POST_BOOT_IO = []() consteval {
+	using namespace memory::addrs;
+	return std::to_array<reg_value>({
+		{JOYPAD, 0xCF}, {SERIAL_DATA, 0x00}, {SERIAL_CONTROL, 0x7E}, {DIVIDER, 0xAB},
+		{TIMER_COUNTER, 0x00}, {TIMER_MODULO, 0x00}, {TIMER_CONTROL, 0xF8}, {INTERRUPT_FLAG, 0xE1},
+		{LCD_CONTROL, 0x91}, {LCD_STATUS, 0x85}, {LCD_SCROLL_Y, 0x00}, {LCD_SCROLL_X, 0x00},
+		{LCD_CUR_Y, 0x00}, {LCD_CMP_Y, 0x00}, {OAM_DMA, 0xFF}, {BG_PALETTE_DATA, 0xFC},
+		{LCD_WINDOW_Y, 0x00}, {LCD_WINDOW_X, 0x00}, {BOOT_ROM_SELECT, 0x01}, {INTERRUPT_ENABLE, 0x00},
+	});
+}();
+
+// written in this order after turning the APU on. the boot sound's last note (channel 1) is left off rather than
+// triggered, so NR52 reads F0 instead of F1 and nothing plays.
+constexpr auto POST_BOOT_AUDIO = []() consteval {
+	using namespace apu::addrs;
+	return std::to_array<reg_value>({
+		{NR10, 0x80}, {NR11, 0xBF}, {NR12, 0xF3}, {NR13, 0xFF}, {NR14, 0x3F},
+		{NR21, 0x3F}, {NR22, 0x00}, {NR23, 0xFF}, {NR24, 0x3F},
+		{NR30, 0x7F}, {NR31, 0xFF}, {NR32, 0x9F}, {NR33, 0xFF}, {NR34, 0x3F},
+		{NR41, 0xFF}, {NR42, 0x00}, {NR43, 0x00}, {NR44, 0x3F},
+		{NR50, 0x77}, {NR51, 0xF3},
+	});
+}();
+
+// the ® after the logo, a row per byte
+constexpr std::array<uint8_t, 8> REGISTERED_TILE{0x3C, 0x42, 0xB9, 0xA5, 0xB9, 0xA5, 0x42, 0x3C};
+
+// each bit twice, for the logo's 2x2 pixels
+constexpr uint8_t stretch_nybble(uint8_t nybble) {
+	uint8_t ret = 0;
+	for(uint8_t bit = 0; bit < 4; ++bit) {
+		if(get_bit(nybble, bit)) ret |= static_cast<uint8_t>(0b11 << (2 * bit));
+	}
+	return ret;
+}
+
+}
+
+std::vector<uint8_t> load_boot_rom(std::string_view arg) {
+	if(arg == "-") return {};
+	return load_file(std::filesystem::path{arg});
+}
+
+void gameboy_emulator::skip_boot() {
+	using namespace memory::addrs;
+	const auto& cartridge = std::as_const(mmu).get_cartridge();
+
+	// the boot ROM leaves the carry flags set unless the header checksum is 0
+	cpu.set_registers({
+		.af = static_cast<uint16_t>(cartridge.read(HEADER_CHECKSUM) ? 0x01B0 : 0x0180),
+		.bc = 0x0013,
+		.de = 0x00D8,
+		.hl = 0x014D,
+		.sp = 0xFFFE,
+		.pc = 0x0100,
+		.ime = false,
+		.halted = false,
+	});
+
+	const auto high_mem = mmu.raw_high_mem();
+	for(const auto [addr, value] : POST_BOOT_IO) high_mem[addr - IO_MMAP_BEGIN] = value;
+	mmu.set_boot_rom_enabled(false);
+	mmu.cancel_transfers();
+
+	// the logo from the cartridge header, scaled up 2x into tiles 1-24 (a header byte is half a tile), then the ®
+	// in tile 25, all in the first bit plane. the tile map has them in the middle of the screen.
+	const auto vram = mmu.raw_vram();
+	for(uint16_t i = 0; i < LOGO_END - LOGO_BEGIN; ++i) {
+		const uint8_t logo = cartridge.read(static_cast<uint16_t>(LOGO_BEGIN + i));
+		const size_t row = 0x10 + i * 8; // two pixel rows per nybble, each 2 bytes
+		vram[row] = vram[row + 2] = stretch_nybble(static_cast<uint8_t>(logo >> 4));
+		vram[row + 4] = vram[row + 6] = stretch_nybble(static_cast<uint8_t>(logo & 0xF));
+	}
+	for(size_t i = 0; i < REGISTERED_TILE.size(); ++i) vram[0x190 + i * 2] = REGISTERED_TILE[i];
+	for(uint8_t i = 0; i < 12; ++i) {
+		vram[0x1904 + i] = static_cast<uint8_t>(1 + i);
+		vram[0x1924 + i] = static_cast<uint8_t>(13 + i);
+	}
+	vram[0x1910] = 25;
+
+	// the same way bess.cpp brings audio in from outside: from power off, without triggering anything
+	apu.sync(total_tclks);
+	apu.reset();
+	apu.set_div(total_tclks, high_mem[DIVIDER - IO_MMAP_BEGIN]);
+	apu.write(apu::addrs::NR52, 0x80);
+	for(const auto [addr, value] : POST_BOOT_AUDIO) apu.write(addr, value);
+
+	ppu.restart_line();
+}
+
+}
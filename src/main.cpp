@@ -15,9 +15,9 @@ int main(int argc, char* argv[]) {
 
 	try {
 		auto ui = gb::ui::UI::create(argv[1], argc, argv);
-		ui->main_loop();
-		gb::log_info("Exiting with code 0");
-		return 0;
+		const int ret = ui->main_loop();
+		gb::log_info("Exiting with code {}", ret);
+		return ret;
 	} catch (const std::exception& e) {
 		std::cerr << "Uncaught exception: " << e.what() << '\n';
 		if(errno) {
@@ -7,7 +7,9 @@ namespace gb::memory {
 
 // Figure out which mapper should be used, and initialize it.
 // Also checks some common info to all mappers (rom/ram size correct, etc)
-Cartridge::mapper_variant_t init_mapper(std::span<const uint8_t> rom, std::optional<std::span<const uint8_t>> save_data) {
+Cartridge::mapper_variant_t init_mapper(SharedRom shared_rom, std::optional<std::span<const uint8_t>> save_data) {
+	if(!shared_rom) throw_exc("No rom");
+	const std::span<const uint8_t> rom = *shared_rom;
 	if(rom.size() < 32'768) throw_exc("Rom size of {} bytes too small", rom.size());
 	
 	const auto rom_size_raw = rom[memory::addrs::ROM_SIZE];
@@ -35,16 +37,16 @@ Cartridge::mapper_variant_t init_mapper(std::span<const uint8_t> rom, std::optio
 	switch(cartridge_type){
 		using namespace mappers;
 		case 0x00: // ROM only
-			return NoMapper{rom, save_data};
+			return NoMapper{std::move(shared_rom), save_data};
 		case 0x01: // MBC1
 		case 0x02: // MBC1+RAM
 		case 0x03: // MBC1+RAM+battery
-			return MBC1{rom, save_data};
+			return MBC1{std::move(shared_rom), save_data};
 	}
 	throw_exc("Unrecognized cartridge type {:#04x}", cartridge_type);
 }
 
-Cartridge::Cartridge(std::span<const uint8_t> rom, std::optional<std::span<const uint8_t>> save_data): mapper_variant{init_mapper(rom, save_data)}
+Cartridge::Cartridge(SharedRom rom, std::optional<std::span<const uint8_t>> save_data): mapper_variant{init_mapper(std::move(rom), save_data)}
 {
 	log_info("Loaded cartridge with title \"{}\", version {}", title(), read(addrs::ROM_VERSION));
 }
@@ -0,0 +1,288 @@
+#include <gb/movie.h>
+#include <gb/utils/bytes.h>
+#include <gb/utils/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace gb::movie {
+
+namespace {
+
+constexpr uint32_t VERSION = 2;
+
+struct header {
+	char magic[4];
+	uint32_t version;
+	uint64_t rom_hash;
+	uint32_t state_size;
+	uint32_t keyframe_interval;
+	uint8_t granularity;
+	uint8_t renderer; // requested, see ppu::PPU::set_renderer(): they don't all take the same time to draw a line
+	uint8_t reserved[6];
+};
+
+struct footer {
+	uint64_t frames;
+	uint64_t changes;
+	uint64_t keyframes;
+	uint64_t index_offset;
+	char magic[8];
+};
+
+struct keyframe_entry {
+	uint64_t frame;
+	uint64_t change_index; // changes recorded before it
+	uint64_t state_offset;
+};
+
+static_assert(sizeof(header) == 32 && sizeof(footer) == 40 && sizeof(keyframe_entry) == 24, "no padding in the file format");
+
+constexpr char HEADER_MAGIC[4]{'G', 'B', 'M', 'V'};
+constexpr char FOOTER_MAGIC[8]{'G', 'B', 'M', 'V', ' ', 'E', 'N', 'D'};
+
+// record kinds: a change picked up at the start of a frame or when the game read the joypad, or a keyframe
+constexpr uint8_t FRAME_CHANGE = 0, READ_CHANGE = 1, KEYFRAME = 2;
+constexpr size_t CHANGE_BYTES = 2 + sizeof(uint64_t); // kind, buttons, mclk
+
+}
+
+Recorder::Recorder(gameboy_emulator& emulator, const std::filesystem::path& path, joypad::InputSource* live, Granularity granularity, unsigned keyframe_interval)
+	: emulator{emulator}, live{live}, granularity{granularity}, keyframe_interval{std::max(keyframe_interval, 1u)}, file{path}, last_buttons{emulator.held_buttons()}
+{
+	scratch = emulator.save_state();
+	header h{
+		.magic = {},
+		.version = VERSION,
+		.rom_hash = emulator.rom_hash(),
+		.state_size = static_cast<uint32_t>(scratch.size()),
+		.keyframe_interval = this->keyframe_interval,
+		.granularity = static_cast<uint8_t>(granularity),
+		.renderer = static_cast<uint8_t>(emulator.ppu.renderer_requested()),
+		.reserved = {},
+	};
+	std::memcpy(h.magic, HEADER_MAGIC, sizeof(h.magic));
+	file.write(as_bytes(h));
+	file.write(scratch);
+	emulator.set_input_source(this);
+	log_info("Recording input to {}", path.string());
+}
+
+Recorder::~Recorder() {
+	try {
+		finish();
+	} catch (const std::exception& e) {
+		log_error("Error finishing movie: {}", e.what());
+	}
+}
+
+void Recorder::frame_start() {
+	if(frame_count && frame_count % keyframe_interval == 0) {
+		emulator.save_state(scratch);
+		file.write(as_bytes(KEYFRAME));
+		const keyframe_entry entry{.frame = frame_count, .change_index = change_count, .state_offset = file.size()};
+		const auto entry_bytes = as_bytes(entry);
+		index.insert(index.end(), entry_bytes.begin(), entry_bytes.end());
+		file.write(scratch);
+		++keyframe_count;
+	}
+	record_changes(FRAME_CHANGE, emulator.total_mclks);
+	++frame_count;
+}
+
+void Recorder::poll(uint64_t mclk) {
+	// per frame, input that comes in mid-frame waits for the next frame_start(), or playback couldn't put it back in the same place
+	if(granularity != Granularity::JOYPAD_READ) return;
+	if(live) live->poll(mclk);
+	record_changes(READ_CHANGE, mclk);
+}
+
+void Recorder::record_changes(uint8_t kind, uint64_t mclk) {
+	const Buttons buttons = emulator.held_buttons();
+	if(buttons == last_buttons) return;
+	last_buttons = buttons;
+	uint8_t record[CHANGE_BYTES]{kind, buttons};
+	std::memcpy(record + 2, &mclk, sizeof(mclk));
+	file.write(record);
+	++change_count;
+}
+
+void Recorder::finish() {
+	if(finished) return;
+	finished = true;
+	emulator.set_input_source(live);
+	footer f{
+		.frames = frame_count,
+		.changes = change_count,
+		.keyframes = keyframe_count,
+		.index_offset = file.size(),
+		.magic = {},
+	};
+	std::memcpy(f.magic, FOOTER_MAGIC, sizeof(f.magic));
+	file.write(index);
+	file.write(as_bytes(f));
+	file.close();
+	log_info("Recorded {} frames of input, {} changes", frame_count, change_count);
+}
+
+Movie::Movie(std::span<const uint8_t> file) {
+	const auto h = read_at<header>(file, 0, "Movie");
+	if(std::memcmp(h.magic, HEADER_MAGIC, sizeof(h.magic)) != 0) throw_exc("Not a movie");
+	if(h.version != VERSION) throw_exc("Movie is version {}, expected {}", h.version, VERSION);
+	if(h.renderer > static_cast<uint8_t>(ppu::Renderer::AUTO)) throw_exc("Movie has unknown renderer {}", h.renderer);
+	if(file.size() < sizeof(header) + h.state_size + sizeof(footer)) throw_exc("Movie cut off at {} bytes", file.size());
+	const auto f = read_at<footer>(file, file.size() - sizeof(footer), "Movie");
+	if(std::memcmp(f.magic, FOOTER_MAGIC, sizeof(f.magic)) != 0) throw_exc("Movie wasn't finished");
+	if(f.index_offset > file.size() - sizeof(footer) || f.keyframes != (file.size() - sizeof(footer) - f.index_offset) / sizeof(keyframe_entry)) {
+		throw_exc("Movie index is broken");
+	}
+	rom_hash = h.rom_hash;
+	renderer = static_cast<ppu::Renderer>(h.renderer);
+	start_state = file.subspan(sizeof(header), h.state_size);
+	frame_count = f.frames;
+
+	keyframes.reserve(f.keyframes);
+	for(uint64_t i = 0; i < f.keyframes; ++i) {
+		const auto entry = read_at<keyframe_entry>(file, f.index_offset + i * sizeof(keyframe_entry), "Movie");
+		if(entry.state_offset > f.index_offset || h.state_size > f.index_offset - entry.state_offset) throw_exc("Movie index is broken");
+		keyframes.push_back({.frame = entry.frame, .change_index = entry.change_index, .state = file.subspan(entry.state_offset, h.state_size)});
+	}
+
+	// the changes are a few bytes each between the keyframes, read them all up front
+	changes.reserve(f.changes);
+	for(size_t pos = sizeof(header) + h.state_size; pos < f.index_offset;) {
+		const auto kind = file[pos];
+		if(kind == KEYFRAME) {
+			pos += 1 + h.state_size;
+			continue;
+		}
+		if(kind != FRAME_CHANGE && kind != READ_CHANGE) throw_exc("Unknown movie record {} at {}", kind, pos);
+		changes.push_back({.mclk = read_at<uint64_t>(file, pos + 2, "Movie"), .kind = kind, .buttons = read_at<Buttons>(file, pos + 1, "Movie")});
+		pos += CHANGE_BYTES;
+	}
+	if(changes.size() != f.changes) throw_exc("Movie has {} changes, expected {}", changes.size(), f.changes);
+}
+
+std::vector<uint64_t> Movie::keyframe_frames() const {
+	std::vector<uint64_t> ret;
+	ret.reserve(keyframes.size());
+	for(const auto& k : keyframes) ret.push_back(k.frame);
+	return ret;
+}
+
+Player::Player(gameboy_emulator& emulator, const Movie& movie) : emulator{emulator}, movie{movie} {
+	if(movie.rom_hash != emulator.rom_hash()) throw_exc("Movie is for a different ROM");
+	if(!emulator.can_load_state(movie.start_state)) throw_exc("Movie was recorded by another build");
+	emulator.ppu.set_renderer(movie.renderer);
+	load(movie.start_state, 0, 0);
+	emulator.set_input_source(this);
+}
+
+Player::~Player() {
+	emulator.set_input_source(nullptr);
+}
+
+void Player::run_frame() {
+	const auto& changes = movie.changes;
+	for(; next_change < changes.size() && changes[next_change].kind == FRAME_CHANGE && changes[next_change].mclk <= emulator.total_mclks; ++next_change) {
+		emulator.set_buttons(changes[next_change].buttons);
+	}
+	emulator.run_frame();
+	++cur_frame;
+}
+
+void Player::poll(uint64_t mclk) {
+	const auto& changes = movie.changes;
+	for(; next_change < changes.size() && changes[next_change].mclk <= mclk; ++next_change) {
+		emulator.set_buttons(changes[next_change].buttons);
+	}
+}
+
+void Player::seek(uint64_t frame) {
+	// the last keyframe at or before frame
+	const auto& keyframes = movie.keyframes;
+	const auto it = std::ranges::upper_bound(keyframes, frame, {}, &Movie::keyframe::frame);
+	const uint64_t from = it == keyframes.begin() ? 0 : std::prev(it)->frame;
+	if(frame < cur_frame || from > cur_frame) {
+		if(it == keyframes.begin()) load(movie.start_state, 0, 0);
+		else load(std::prev(it)->state, std::prev(it)->frame, std::prev(it)->change_index);
+	}
+	if(cur_frame == frame) return;
+
+	emulator.apu.pause_output();
+	while(cur_frame < frame) {
+		emulator.ppu.set_frame_skip(cur_frame + 1 != frame);
+		run_frame();
+	}
+	emulator.ppu.set_frame_skip(false);
+	emulator.apu.resume_output();
+}
+
+void Player::load(std::span<const uint8_t> state, uint64_t frame, uint64_t change_index) {
+	emulator.load_state(state);
+	cur_frame = frame;
+	next_change = change_index;
+}
+
+void render(const Movie& movie, const EmulatorFactory& make_emulator, const FrameSink& sink, ThreadPool& pool) {
+	// a segment runs from the start state or a keyframe up to the next keyframe (or the end).
+	// frames are kept packed until sink gets them, to keep the ones waiting small.
+	struct segment {
+		uint64_t begin = 0, end = 0;
+		std::vector<ppu::PackedFrame> frames;
+		TaskGroup done;
+	};
+	std::vector<uint64_t> starts{0};
+	for(const uint64_t frame : movie.keyframe_frames()) {
+		if(frame > starts.back() && frame < movie.frames()) starts.push_back(frame);
+	}
+	std::vector<std::unique_ptr<segment>> segments;
+	for(size_t i = 0; i < starts.size(); ++i) {
+		auto& seg = *segments.emplace_back(std::make_unique<segment>());
+		seg.begin = starts[i];
+		seg.end = i + 1 < starts.size() ? starts[i + 1] : movie.frames();
+	}
+
+	const auto run_segment = [&movie, &make_emulator](segment& seg) {
+		const auto emulator = make_emulator();
+		emulator->apu.set_output_enabled(false);
+		Player player{*emulator, movie};
+		player.seek(seg.begin);
+		seg.frames.resize(seg.end - seg.begin);
+		for(auto& frame : seg.frames) {
+			player.run_frame();
+			emulator->export_frame(ppu::FrameFormat::PACKED_2BPP, {reinterpret_cast<uint8_t*>(&frame), sizeof(frame)});
+		}
+	};
+
+	const size_t ahead = 2 * std::max(pool.size(), 1u);
+	size_t submitted = 0;
+	try {
+		ppu::Frame frame;
+		for(size_t i = 0; i < segments.size(); ++i) {
+			for(; submitted < segments.size() && submitted < i + ahead; ++submitted) {
+				auto& seg = *segments[submitted];
+				pool.submit(seg.done, [&run_segment, &seg] { run_segment(seg); });
+			}
+			auto& seg = *segments[i];
+			pool.wait(seg.done);
+			for(size_t j = 0; j < seg.frames.size(); ++j) {
+				ppu::unpack(seg.frames[j], frame);
+				sink(seg.begin + j + 1, frame);
+			}
+			segments[i].reset();
+		}
+	} catch (...) {
+		// the rest are still using segments
+		for(size_t i = 0; i < submitted; ++i) {
+			if(!segments[i]) continue;
+			try {
+				pool.wait(segments[i]->done);
+			} catch (...) {}
+		}
+		throw;
+	}
+}
+
+}
@@ -0,0 +1,152 @@
+#include <gb/page_store.h>
+#include <gb/utils/hash.h>
+#include <gb/utils/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace gb {
+
+PageStore::Snapshot& PageStore::Snapshot::operator=(Snapshot&& other) noexcept {
+	if(this != &other) {
+		reset();
+		store = std::exchange(other.store, nullptr);
+		registers = std::move(other.registers);
+		pages = std::move(other.pages);
+	}
+	return *this;
+}
+
+void PageStore::Snapshot::reset() {
+	if(!store) return;
+	{
+		std::lock_guard guard{store->lock};
+		store->release(pages);
+		--store->snapshots;
+	}
+	store = nullptr;
+	registers = {};
+	pages = {};
+}
+
+PageStore::~PageStore() {
+	if(snapshots) log_error("Page store destroyed with {} snapshots still in it", snapshots);
+}
+
+PageStore::Snapshot PageStore::save(gameboy_emulator& emulator) {
+	// per thread, so only interning the pages needs the lock
+	thread_local std::vector<uint8_t> state;
+	thread_local std::vector<std::array<uint8_t, PAGE_SIZE>> page_data;
+	thread_local std::vector<uint64_t> hashes;
+
+	state.resize(emulator.state_size());
+	emulator.save_state(state);
+	{
+		std::lock_guard guard{lock};
+		if(layout.sections().empty()) layout = emulator.state_layout();
+		else if(layout.size() != state.size()) throw_exc("Page store has states of {} bytes, not {}", layout.size(), state.size());
+	}
+
+	Snapshot ret;
+	page_data.clear();
+	for(const auto& section : layout.sections()) {
+		const auto bytes = std::span{state}.subspan(section.offset, section.size);
+		if(!section.memory) {
+			ret.registers.insert(ret.registers.end(), bytes.begin(), bytes.end());
+			continue;
+		}
+		// the last page of a section is padded with zeros
+		for(size_t pos = 0; pos < bytes.size(); pos += PAGE_SIZE) {
+			auto& data = page_data.emplace_back();
+			const size_t len = std::min(PAGE_SIZE, bytes.size() - pos);
+			std::memcpy(data.data(), bytes.data() + pos, len);
+			std::fill(data.begin() + len, data.end(), uint8_t{0});
+		}
+	}
+	hashes.resize(page_data.size());
+	for(size_t i = 0; i < page_data.size(); ++i) hashes[i] = fast_hash(page_data[i]);
+
+	ret.pages.resize(page_data.size());
+	std::lock_guard guard{lock};
+	for(size_t i = 0; i < page_data.size(); ++i) ret.pages[i] = intern(page_data[i], hashes[i]);
+	ret.store = this;
+	++snapshots;
+	return ret;
+}
+
+void PageStore::restore(const Snapshot& snapshot, std::span<uint8_t> out) const {
+	if(snapshot.store != this) throw_exc("Snapshot isn't from this page store");
+	std::lock_guard guard{lock};
+	if(out.size() != layout.size()) throw_exc("Save state buffer is {} bytes, expected {}", out.size(), layout.size());
+	size_t reg_pos = 0, page_index = 0;
+	for(const auto& section : layout.sections()) {
+		const auto bytes = out.subspan(section.offset, section.size);
+		if(!section.memory) {
+			std::memcpy(bytes.data(), snapshot.registers.data() + reg_pos, bytes.size());
+			reg_pos += bytes.size();
+			continue;
+		}
+		for(size_t pos = 0; pos < bytes.size(); pos += PAGE_SIZE) {
+			std::memcpy(bytes.data() + pos, pages[snapshot.pages[page_index++]].data.data(), std::min(PAGE_SIZE, bytes.size() - pos));
+		}
+	}
+}
+
+void PageStore::load(const Snapshot& snapshot, gameboy_emulator& emulator) const {
+	thread_local std::vector<uint8_t> state;
+	state.resize(state_size());
+	restore(snapshot, state);
+	emulator.load_state(state);
+}
+
+size_t PageStore::state_size() const {
+	std::lock_guard guard{lock};
+	return layout.size();
+}
+
+PageStore::stats PageStore::get_stats() const {
+	std::lock_guard guard{lock};
+	return {
+		.snapshots = snapshots,
+		.page_refs = page_refs,
+		.unique_pages = pages.size() - free_ids.size(),
+		.bytes = pages.capacity() * sizeof(page) + index.bucket_count() * sizeof(void*) + index.size() * (sizeof(decltype(index)::value_type) + sizeof(void*)),
+	};
+}
+
+PageStore::PageId PageStore::intern(const std::array<uint8_t, PAGE_SIZE>& data, uint64_t hash) {
+	++page_refs;
+	const auto [begin, end] = index.equal_range(hash);
+	for(auto it = begin; it != end; ++it) {
+		auto& p = pages[it->second];
+		if(p.data == data) {
+			++p.refs;
+			return it->second;
+		}
+	}
+	PageId id;
+	if(!free_ids.empty()) {
+		id = free_ids.back();
+		free_ids.pop_back();
+	} else {
+		id = static_cast<PageId>(pages.size());
+		pages.emplace_back();
+	}
+	pages[id] = {.data = data, .hash = hash, .refs = 1};
+	index.emplace(hash, id);
+	return id;
+}
+
+void PageStore::release(std::span<const PageId> ids) {
+	page_refs -= ids.size();
+	for(const PageId id : ids) {
+		auto& p = pages[id];
+		if(--p.refs) continue;
+		const auto [begin, end] = index.equal_range(p.hash);
+		index.erase(std::find_if(begin, end, [id](const auto& entry) { return entry.second == id; }));
+		free_ids.push_back(id);
+	}
+}
+
+}
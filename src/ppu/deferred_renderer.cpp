@@ -0,0 +1,50 @@
+#include <gb/ppu/deferred_renderer.h>
+
+#include <algorithm>
+
+namespace gb::ppu {
+
+void DeferredRenderer::begin_frame(const VideoMemoryView& mem) {
+	using namespace memory::addrs;
+	auto& job = recording();
+	std::copy_n(mem.vram, job.snapshot.vram.size(), job.snapshot.vram.begin());
+	std::copy_n(mem.oam, job.snapshot.oam.size(), job.snapshot.oam.begin());
+	std::copy_n(mem.lcd_regs, job.snapshot.lcd_regs.size(), job.snapshot.lcd_regs.begin());
+	job.log.entries.clear();
+	job.log.now = 0;
+}
+
+void DeferredRenderer::submit(Frame& out) {
+	wait(); // the previous frame must be done before its job is reused for recording.
+	const frame_job& job = recording();
+	recording_idx ^= 1;
+
+	// a few lines per task, so each task's log replay prefix is short relative to the drawing it does.
+	const unsigned num_chunks = std::clamp(pool.size() * 2, 1u, LCD_HEIGHT);
+	for(unsigned chunk = 0; chunk < num_chunks; ++chunk) {
+		const unsigned first_line = (chunk * LCD_HEIGHT) / num_chunks;
+		const unsigned end_line = ((chunk + 1) * LCD_HEIGHT) / num_chunks;
+		pool.submit(in_flight, [&job, &out, first_line, end_line]{ render_lines(job, out, first_line, end_line); });
+	}
+}
+
+void DeferredRenderer::video_memory::apply(const memory::WriteLog::entry& write) {
+	using namespace memory::addrs;
+	if(write.addr >= VRAM_BEGIN && write.addr < VRAM_END) vram[write.addr - VRAM_BEGIN] = write.data;
+	else if(write.addr >= OAM_BEGIN && write.addr < OAM_END) oam[write.addr - OAM_BEGIN] = write.data;
+	else if(write.addr >= LCDS_BEGIN && write.addr < LCDS_END) lcd_regs[write.addr - LCDS_BEGIN] = write.data;
+}
+
+void DeferredRenderer::render_lines(const frame_job& job, Frame& out, unsigned first_line, unsigned end_line) {
+	// the log is in time order. a write stamped with line ly happened before line ly was drawn.
+	video_memory mem = job.snapshot;
+	const auto view = mem.view();
+	const auto& entries = job.log.entries;
+	auto next = entries.begin();
+	for(unsigned ly = first_line; ly < end_line; ++ly) {
+		for(; next != entries.end() && next->time <= ly; ++next) mem.apply(*next);
+		ScanlineRenderer::draw_line(job.lines[ly], view, out[ly]);
+	}
+}
+
+}
@@ -0,0 +1,73 @@
+#include <gb/ppu/observation.h>
+#include <gb/utils/log.h>
+
+namespace gb::ppu {
+
+namespace {
+
+constexpr std::array<uint8_t, 4> INTENSITY{255, 170, 85, 0};
+
+}
+
+Observer::Observer(const ObservationConfig& config_in) : config{config_in} {
+	if(config.crop_width == 0 || config.crop_height == 0 || config.crop_x + config.crop_width > LCD_WIDTH || config.crop_y + config.crop_height > LCD_HEIGHT) {
+		throw_exc("Crop region {}x{} at ({}, {}) is outside the LCD", config.crop_width, config.crop_height, config.crop_x, config.crop_y);
+	}
+	if(config.width == 0 || config.height == 0 || config.width > config.crop_width || config.height > config.crop_height) {
+		throw_exc("Observation size {}x{} must be nonzero and at most the crop size", config.width, config.height);
+	}
+	if(config.stack_size == 0) throw_exc("Observation stack size must be at least 1");
+
+	const auto boundaries = [filter = config.filter](auto& out, unsigned crop_begin, unsigned crop_size, unsigned out_size) {
+		for(unsigned i = 0; i <= out_size; ++i) {
+			const unsigned offset = (filter == ObservationConfig::Filter::NEAREST)
+				? ((2 * i + 1) * crop_size) / (2 * out_size) // center of output pixel
+				: (i * crop_size) / out_size; // left edge of output pixel
+			out[i] = static_cast<uint8_t>(crop_begin + offset);
+		}
+	};
+	boundaries(col_begin, config.crop_x, config.crop_width, config.width);
+	boundaries(row_begin, config.crop_y, config.crop_height, config.height);
+}
+
+void Observer::write(const Frame& frame, std::span<uint8_t> out) {
+	if(out.size() < buffer_bytes()) throw_exc("Observation buffer has size {}, expected at least {}", out.size(), buffer_bytes());
+	uint8_t* plane_out = out.data() + (writes % config.stack_size) * plane_bytes();
+	if(config.filter == ObservationConfig::Filter::NEAREST) write_nearest(frame, plane_out);
+	else write_box(frame, plane_out);
+	++writes;
+}
+
+void Observer::write_nearest(const Frame& frame, uint8_t* out) const {
+	for(unsigned y = 0; y < config.height; ++y) {
+		const auto& line = frame[row_begin[y]];
+		for(unsigned x = 0; x < config.width; ++x) {
+			*out++ = INTENSITY[line[col_begin[x]].raw & 3];
+		}
+	}
+}
+
+void Observer::write_box(const Frame& frame, uint8_t* out) const {
+	// sum each band of source rows into column totals first, then sum columns per output pixel.
+	// max column total is 144 * 255, which fits in 16 bits.
+	std::array<uint16_t, LCD_WIDTH> column_sums;
+	const unsigned crop_end_x = config.crop_x + config.crop_width;
+	for(unsigned y = 0; y < config.height; ++y) {
+		std::fill(column_sums.begin() + config.crop_x, column_sums.begin() + crop_end_x, uint16_t{0});
+		for(unsigned src_y = row_begin[y]; src_y < row_begin[y + 1]; ++src_y) {
+			const auto& line = frame[src_y];
+			for(unsigned src_x = config.crop_x; src_x < crop_end_x; ++src_x) {
+				column_sums[src_x] += INTENSITY[line[src_x].raw & 3];
+			}
+		}
+		const unsigned rows = row_begin[y + 1] - row_begin[y];
+		for(unsigned x = 0; x < config.width; ++x) {
+			uint32_t total = 0;
+			for(unsigned src_x = col_begin[x]; src_x < col_begin[x + 1]; ++src_x) total += column_sums[src_x];
+			const unsigned area = rows * (col_begin[x + 1] - col_begin[x]);
+			*out++ = static_cast<uint8_t>((total + area / 2) / area);
+		}
+	}
+}
+
+}
@@ -0,0 +1,146 @@
+#include <gb/ppu/packed_frame.h>
+#include <gb/utils/log.h>
+#include <gb/utils/simd.h>
+
+#include <cstring>
+
+namespace gb::ppu {
+
+namespace {
+
+const uint8_t* raw_bytes(const Frame& frame) { return &frame.front().front().raw; }
+uint8_t* raw_bytes(Frame& frame) { return &frame.front().front().raw; }
+
+}
+
+void pack(const Frame& in, PackedFrame& out) {
+	const uint8_t* src = raw_bytes(in);
+	uint8_t* dst = out.front().data();
+#if GB_SIMD_SSE2
+	// each 32 bit lane holds 4 pixels b0-b3 (one per byte), fold them into the low byte:
+	// x | (x >> 6) puts b1 next to b0 (and b3 next to b2), then x | (x >> 12) brings b2:b3 down next to b0:b1.
+	const auto pack16 = [](const uint8_t* px) {
+		__m128i x = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(px)), _mm_set1_epi8(3));
+		x = _mm_or_si128(x, _mm_srli_epi32(x, 6));
+		x = _mm_or_si128(x, _mm_srli_epi32(x, 12));
+		return _mm_and_si128(x, _mm_set1_epi32(0xFF));
+	};
+	static_assert(FRAME_PIXELS % 64 == 0);
+	for(size_t i = 0; i < FRAME_PIXELS; i += 64, src += 64, dst += 16) {
+		const __m128i lo = _mm_packs_epi32(pack16(src), pack16(src + 16));
+		const __m128i hi = _mm_packs_epi32(pack16(src + 32), pack16(src + 48));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(lo, hi));
+	}
+#else
+	for(size_t i = 0; i < FRAME_PIXELS; i += 4, src += 4) {
+		*dst++ = static_cast<uint8_t>((src[0] & 3) | ((src[1] & 3) << 2) | ((src[2] & 3) << 4) | ((src[3] & 3) << 6));
+	}
+#endif
+}
+
+void unpack(const PackedFrame& in, Frame& out) {
+	const uint8_t* src = in.front().data();
+	uint8_t* dst = raw_bytes(out);
+#if GB_SIMD_SSE2
+	// inverse of pack: zero extend each packed byte p to a 32 bit lane,
+	// then p | p << 6 | p << 12 | p << 18 puts pixel n in the low bits of byte n.
+	const auto expand = [](__m128i x) {
+		x = _mm_or_si128(_mm_or_si128(x, _mm_slli_epi32(x, 6)), _mm_or_si128(_mm_slli_epi32(x, 12), _mm_slli_epi32(x, 18)));
+		return _mm_and_si128(x, _mm_set1_epi32(0x0303'0303));
+	};
+	const __m128i zero = _mm_setzero_si128();
+	for(size_t i = 0; i < sizeof(PackedFrame); i += 16, src += 16, dst += 64) {
+		const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		const __m128i lo = _mm_unpacklo_epi8(packed, zero);
+		const __m128i hi = _mm_unpackhi_epi8(packed, zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), expand(_mm_unpacklo_epi16(lo, zero)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), expand(_mm_unpackhi_epi16(lo, zero)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), expand(_mm_unpacklo_epi16(hi, zero)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), expand(_mm_unpackhi_epi16(hi, zero)));
+	}
+#else
+	for(size_t i = 0; i < sizeof(PackedFrame); ++i, ++src) {
+		for(int px = 0; px < 4; ++px) *dst++ = (*src >> (2 * px)) & 3;
+	}
+#endif
+}
+
+void unpack_rgba(const PackedFrame& in, RGBAFrame out, const RGBAPalette& palette) {
+	// a packed byte expands to exactly 16 bytes of RGBA, so a 4KB table turns this into one copy per byte.
+	std::array<std::array<uint32_t, 4>, 256> lut;
+	for(unsigned packed = 0; packed < lut.size(); ++packed) {
+		for(unsigned px = 0; px < 4; ++px) lut[packed][px] = palette[(packed >> (2 * px)) & 3];
+	}
+	uint32_t* dst = out.data();
+	for(const auto& line : in) {
+		for(const uint8_t packed : line) {
+			std::memcpy(dst, lut[packed].data(), sizeof(lut[packed]));
+			dst += 4;
+		}
+	}
+}
+
+void pack_rgba(ConstRGBAFrame in, PackedFrame& out, const RGBAPalette& palette) {
+	const uint32_t* src = in.data();
+	uint8_t* dst = out.front().data();
+#if GB_SIMD_SSE2
+	// compare each pixel against palette entries 1-3 to get its index in a 32 bit lane,
+	// then narrow to one pixel per byte and fold 4 pixels into a byte like pack() does.
+	const __m128i pal1 = _mm_set1_epi32(static_cast<int>(palette[1]));
+	const __m128i pal2 = _mm_set1_epi32(static_cast<int>(palette[2]));
+	const __m128i pal3 = _mm_set1_epi32(static_cast<int>(palette[3]));
+	const auto index4 = [&](const uint32_t* px) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px));
+		__m128i idx = _mm_and_si128(_mm_cmpeq_epi32(x, pal1), _mm_set1_epi32(1));
+		idx = _mm_or_si128(idx, _mm_and_si128(_mm_cmpeq_epi32(x, pal2), _mm_set1_epi32(2)));
+		return _mm_or_si128(idx, _mm_and_si128(_mm_cmpeq_epi32(x, pal3), _mm_set1_epi32(3)));
+	};
+	const auto index16 = [&](const uint32_t* px) {
+		const __m128i lo = _mm_packs_epi32(index4(px), index4(px + 4));
+		const __m128i hi = _mm_packs_epi32(index4(px + 8), index4(px + 12));
+		__m128i x = _mm_packus_epi16(lo, hi);
+		x = _mm_or_si128(x, _mm_srli_epi32(x, 6));
+		x = _mm_or_si128(x, _mm_srli_epi32(x, 12));
+		return _mm_and_si128(x, _mm_set1_epi32(0xFF));
+	};
+	for(size_t i = 0; i < FRAME_PIXELS; i += 64, src += 64, dst += 16) {
+		const __m128i lo = _mm_packs_epi32(index16(src), index16(src + 16));
+		const __m128i hi = _mm_packs_epi32(index16(src + 32), index16(src + 48));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(lo, hi));
+	}
+#else
+	const auto index = [&palette](uint32_t px) -> uint8_t {
+		for(uint8_t i = 1; i < 4; ++i) if(palette[i] == px) return i;
+		return 0;
+	};
+	for(size_t i = 0; i < FRAME_PIXELS; i += 4, src += 4) {
+		*dst++ = static_cast<uint8_t>(index(src[0]) | (index(src[1]) << 2) | (index(src[2]) << 4) | (index(src[3]) << 6));
+	}
+#endif
+}
+
+void to_rgba(const Frame& in, RGBAFrame out, const RGBAPalette& palette) {
+	const uint8_t* src = raw_bytes(in);
+	for(size_t i = 0; i < FRAME_PIXELS; ++i) out[i] = palette[src[i] & 3];
+}
+
+void export_frame(const Frame& in, FrameFormat format, std::span<uint8_t> out) {
+	if(out.size() != frame_bytes(format)) throw_exc("Frame export buffer has size {}, expected {}", out.size(), frame_bytes(format));
+	switch(format) {
+		case FrameFormat::GRAY8:
+			std::memcpy(out.data(), raw_bytes(in), sizeof(Frame));
+			return;
+		case FrameFormat::PACKED_2BPP:
+			pack(in, *reinterpret_cast<PackedFrame*>(out.data()));
+			return;
+		case FrameFormat::RGBA8888: {
+			// out is only bytes, which needn't be aligned for (or be) uint32_ts, so no to_rgba()
+			const uint8_t* src = raw_bytes(in);
+			for(size_t i = 0; i < FRAME_PIXELS; ++i) std::memcpy(out.data() + i * sizeof(uint32_t), &GRAYSCALE_PALETTE[src[i] & 3], sizeof(uint32_t));
+			return;
+		}
+	}
+	throw_exc("Unknown frame format {}", static_cast<int>(format));
+}
+
+}
@@ -0,0 +1,65 @@
+#include <gb/ppu/scanline_renderer.h>
+
+#include <algorithm>
+#include <array>
+
+namespace gb::ppu {
+
+namespace {
+
+// decode count pixels of a tilemap row into color indices, starting skip pixels into the tile at column col.
+void decode_tiles(uint8_t* out, unsigned count, const uint8_t* map_row, unsigned col, unsigned skip, unsigned fine_y, uint8_t LCDC, const uint8_t* vram) {
+	while(count) {
+		const uint8_t tile_idx_raw = map_row[col++ & 31];
+		const uint16_t tile_idx = tile_idx_raw + (((~LCDC & 0b1'0000) << 4) & ((~tile_idx_raw & 0x80) << 1)); // add 256 if ~LCDC.4 and tile_idx >= 0;
+		const uint8_t* tilerow = vram + (((tile_idx * TILE_SZ) + fine_y) * 2);
+		const unsigned lo = tilerow[0], hi = tilerow[1];
+		for(; skip < TILE_SZ && count; ++skip, --count) {
+			*out++ = static_cast<uint8_t>(((lo >> (7 - skip)) & 1) | (((hi >> (7 - skip)) & 1) << 1));
+		}
+		skip = 0;
+	}
+}
+
+}
+
+void ScanlineRenderer::draw_line(const LineSetup& setup, const VideoMemoryView& mem, Line& out) {
+	using namespace memory::addrs;
+	const auto LCDC = mem.reg<LCD_CONTROL>();
+
+	std::array<uint8_t, LCD_WIDTH> bg{}; // color indices, before palette
+	if(LCDC & 1) {
+		const int window_x = static_cast<int>(mem.reg<LCD_WINDOW_X>()) - 7;
+		const unsigned window_begin = draws_window(setup, mem) ? static_cast<unsigned>(std::max(window_x, 0)) : LCD_WIDTH;
+
+		const uint8_t y = mem.reg<LCD_SCROLL_Y>() + setup.ly;
+		const uint8_t scx = mem.reg<LCD_SCROLL_X>();
+		const uint8_t* bg_map = mem.vram + 0x1800 + (get_bit(LCDC, 3) * 0x400) + ((y >> 3) << 5);
+		decode_tiles(bg.data(), window_begin, bg_map, scx >> 3, scx & 7, y & 7, LCDC, mem.vram);
+
+		if(window_begin < LCD_WIDTH) {
+			const uint8_t wy = setup.window_y_counter;
+			const uint8_t* window_map = mem.vram + 0x1800 + (get_bit(LCDC, 6) * 0x400) + ((wy >> 3) << 5);
+			const unsigned skip = static_cast<unsigned>(std::max(-window_x, 0)); // WX < 7 cuts off the left of the window
+			decode_tiles(bg.data() + window_begin, LCD_WIDTH - window_begin, window_map, skip >> 3, skip & 7, wy & 7, LCDC, mem.vram);
+		}
+	}
+
+	// objects, highest priority first, each only filling pixels not already taken by an opaque object.
+	std::array<obj_px, LCD_WIDTH> objs{};
+	for(unsigned i = setup.num_objects; i-- > 0;) {
+		const auto& obj = setup.objects[i];
+		const auto row = fetch_obj_row(obj, LCDC, mem);
+		for(unsigned px = 0; px < 8; ++px) {
+			const unsigned x = obj.x_plus_8 + px - 8;
+			if(x >= LCD_WIDTH || objs[x].color != TRANSPARENT) continue;
+			objs[x] = row.pixel(px);
+		}
+	}
+
+	for(unsigned x = 0; x < LCD_WIDTH; ++x) {
+		out[x] = mix_pixel(bg[x], objs[x], LCDC, mem);
+	}
+}
+
+}
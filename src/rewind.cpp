@@ -0,0 +1,140 @@
+#include <gb/rewind.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace gb {
+
+Rewinder::Rewinder(size_t budget_bytes, unsigned keyframe_interval)
+	: budget_bytes{budget_bytes}, keyframe_interval{std::max(keyframe_interval, 1u)}
+{}
+
+void Rewinder::set_budget(size_t bytes) {
+	budget_bytes = bytes;
+	evict();
+}
+
+void Rewinder::clear() {
+	while(!entries.empty()) drop_newest();
+	latest.clear();
+}
+
+void Rewinder::capture(gameboy_emulator& emulator) {
+	scratch.resize(emulator.state_size());
+	emulator.save_state(scratch);
+	if(latest.size() != scratch.size()) { // first capture (or a different cartridge)
+		clear();
+		std::swap(latest, scratch);
+		return;
+	}
+
+	entry e;
+	if(!spare.empty()) {
+		e = std::move(spare.back());
+		spare.pop_back();
+	}
+	e.delta.clear();
+	e.keyframe.clear();
+	encode(scratch, latest, e.delta);
+	if(++captures % keyframe_interval == 0) encode({}, latest, e.keyframe);
+	used_bytes += e.bytes();
+	entries.push_back(std::move(e));
+	std::swap(latest, scratch);
+	evict();
+}
+
+bool Rewinder::rewind(gameboy_emulator& emulator, size_t frames) {
+	if(frames == 0 || frames > entries.size()) return false;
+	const size_t target = entries.size() - frames;
+	// walk back from the newest, or from the first keyframe at or after target if that's closer
+	size_t from = entries.size();
+	for(size_t i = target; i < entries.size() && i - target + 1 < from - target; ++i) {
+		if(entries[i].keyframe.empty()) continue;
+		std::fill(latest.begin(), latest.end(), uint8_t{0});
+		apply(entries[i].keyframe, latest);
+		from = i;
+		break;
+	}
+	while(from > target) apply(entries[--from].delta, latest);
+	while(entries.size() > target) drop_newest();
+	emulator.load_state(latest);
+	return true;
+}
+
+void Rewinder::evict() {
+	while(!entries.empty() && memory_used() > budget_bytes) {
+		used_bytes -= entries.front().bytes();
+		recycle(std::move(entries.front()));
+		entries.pop_front();
+	}
+}
+
+void Rewinder::drop_newest() {
+	used_bytes -= entries.back().bytes();
+	recycle(std::move(entries.back()));
+	entries.pop_back();
+}
+
+void Rewinder::recycle(entry&& e) {
+	if(spare.size() < MAX_SPARE) spare.push_back(std::move(e));
+}
+
+void Rewinder::encode(std::span<const uint8_t> base, std::span<const uint8_t> target, std::vector<uint8_t>& out) {
+	std::array<uint8_t, PAGE_SIZE> x;
+	for(size_t page_begin = 0; page_begin < target.size(); page_begin += PAGE_SIZE) {
+		const size_t len = std::min(PAGE_SIZE, target.size() - page_begin);
+		const uint8_t* t = target.data() + page_begin;
+		if(base.empty()) {
+			std::memcpy(x.data(), t, len);
+		} else {
+			const uint8_t* b = base.data() + page_begin;
+			if(std::memcmp(b, t, len) == 0) continue;
+			for(size_t i = 0; i < len; ++i) x[i] = b[i] ^ t[i];
+		}
+		if(std::all_of(x.begin(), x.begin() + len, [](uint8_t v) { return v == 0; })) continue;
+
+		// worst case is all literals: the page index, then a run byte per 128
+		size_t pos = out.size();
+		out.resize(pos + sizeof(uint16_t) + len + (len + 127) / 128);
+		const auto page = static_cast<uint16_t>(page_begin / PAGE_SIZE);
+		std::memcpy(out.data() + pos, &page, sizeof(page));
+		pos += sizeof(page);
+		for(size_t i = 0; i < len;) {
+			size_t run = 0;
+			if(x[i] == 0) {
+				while(i + run < len && run < 128 && x[i + run] == 0) ++run;
+				out[pos++] = static_cast<uint8_t>(run - 1);
+			} else {
+				// literals until a pair of zeros, which is cheaper as a run
+				while(i + run < len && run < 128 && (x[i + run] != 0 || (i + run + 1 < len && x[i + run + 1] != 0))) ++run;
+				out[pos++] = static_cast<uint8_t>(128 + run - 1);
+				std::memcpy(out.data() + pos, x.data() + i, run);
+				pos += run;
+			}
+			i += run;
+		}
+		out.resize(pos);
+	}
+}
+
+void Rewinder::apply(std::span<const uint8_t> changes, std::span<uint8_t> state) {
+	for(size_t pos = 0; pos < changes.size();) {
+		uint16_t page;
+		std::memcpy(&page, changes.data() + pos, sizeof(page));
+		pos += sizeof(page);
+		const size_t page_begin = page * PAGE_SIZE;
+		const size_t len = std::min(PAGE_SIZE, state.size() - page_begin);
+		for(size_t i = 0; i < len;) {
+			const uint8_t token = changes[pos++];
+			const size_t run = (token & 127) + 1;
+			if(token >= 128) {
+				for(size_t j = 0; j < run; ++j) state[page_begin + i + j] ^= changes[pos + j];
+				pos += run;
+			}
+			i += run;
+		}
+	}
+}
+
+}
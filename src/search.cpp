@@ -0,0 +1,100 @@
+#include <gb/search.h>
+#include <gb/utils/hash.h>
+#include <gb/utils/log.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+
+namespace gb::search {
+
+namespace {
+
+struct node {
+	std::vector<uint8_t> state;
+	std::vector<uint8_t> inputs;
+	double score = 0;
+	uint64_t hash = 0;
+};
+
+ram_view view(const gameboy_emulator& emulator) {
+	return {
+		.wram = emulator.mmu.raw_wram(),
+		.high_mem = emulator.mmu.raw_high_mem(),
+		.cartridge_ram = emulator.mmu.get_cartridge().raw_ram(),
+	};
+}
+
+}
+
+result beam_search(gameboy_emulator& emulator, const options& opts, const Scorer& score, ThreadPool& pool) {
+	if(opts.choices.empty() || opts.beam_width == 0) throw_exc("Nothing to search");
+
+	// one emulator per worker. nothing's drawn or heard, only RAM is looked at.
+	const size_t workers = std::max(pool.size(), 1u);
+	std::vector<std::unique_ptr<gameboy_emulator>> clones;
+	for(size_t i = 0; i < workers; ++i) {
+		clones.push_back(emulator.clone());
+		clones.back()->ppu.set_frame_skip(true);
+		clones.back()->apu.set_output_enabled(false);
+	}
+
+	std::vector<node> beam(1);
+	beam[0].state = emulator.save_state();
+	beam[0].score = score(view(emulator));
+	result ret{.inputs = {}, .score = beam[0].score, .state = beam[0].state};
+
+	std::vector<node> children;
+	std::vector<size_t> order;
+	std::unordered_set<uint64_t> seen;
+	for(unsigned step = 0; step < opts.depth && !beam.empty(); ++step) {
+		children.resize(beam.size() * opts.choices.size());
+		pool.parallel_for(workers, [&](size_t worker) {
+			auto& emu = *clones[worker];
+			for(size_t i = worker; i < children.size(); i += workers) {
+				const auto& parent = beam[i / opts.choices.size()];
+				const uint8_t choice = opts.choices[i % opts.choices.size()];
+				emu.load_state(parent.state);
+				emu.set_buttons(choice);
+				for(unsigned f = 0; f < opts.frames_per_step; ++f) emu.run_frame();
+
+				auto& child = children[i];
+				child.state.resize(parent.state.size());
+				emu.save_state(child.state);
+#if GB_STATE_HASH
+				child.hash = emu.state_hash();
+#else
+				child.hash = fast_hash(child.state);
+#endif
+				child.score = score(view(emu));
+				child.inputs = parent.inputs;
+				child.inputs.push_back(choice);
+			}
+		});
+		ret.expanded += children.size();
+
+		// drop duplicates, first come first kept so it doesn't depend on timing. the state includes the clock, so
+		// children of different steps never match.
+		seen.clear();
+		order.clear();
+		for(size_t i = 0; i < children.size(); ++i) {
+			if(seen.insert(children[i].hash).second) order.push_back(i);
+			else ++ret.duplicates;
+		}
+		const size_t keep = std::min(order.size(), opts.beam_width);
+		std::ranges::stable_sort(order, std::greater{}, [&children](size_t i) { return children[i].score; });
+		order.resize(keep);
+
+		beam.clear();
+		for(const size_t i : order) beam.push_back(std::move(children[i]));
+		if(!beam.empty() && beam.front().score > ret.score) {
+			ret.score = beam.front().score;
+			ret.inputs = beam.front().inputs;
+			ret.state = beam.front().state;
+		}
+		log_debug("Search step {}: best score {}, {} duplicates so far", step + 1, beam.empty() ? 0.0 : beam.front().score, ret.duplicates);
+	}
+	return ret;
+}
+
+}
@@ -0,0 +1,222 @@
+#include <gb/state_file.h>
+#include <gb/utils/bytes.h>
+#include <gb/utils/hash.h>
+#include <gb/utils/log.h>
+#include <gb/utils/lz.h>
+
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+namespace gb::state_file {
+
+namespace {
+
+constexpr uint32_t VERSION = 1;
+constexpr char MAGIC[4]{'G', 'B', 'S', 'F'};
+
+struct file_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t rom_hash;
+	uint64_t frame;
+	uint32_t state_version;
+	uint32_t state_size;
+	uint32_t section_count; // the thumbnail, then the state's sections in order
+	uint8_t reserved[12];
+};
+
+struct section_entry {
+	uint32_t size;
+	uint32_t stored_size; // compressed unless it's the same as size
+};
+
+static_assert(sizeof(file_header) == 48 && sizeof(section_entry) == 8, "no padding in the file format");
+
+void decode_section(std::span<const uint8_t> stored, std::span<uint8_t> out) {
+	if(stored.size() == out.size()) std::memcpy(out.data(), stored.data(), out.size());
+	else lz::decompress(stored, out);
+}
+
+}
+
+std::vector<uint8_t> encode(std::span<const uint8_t> state, const StateLayout& layout, const info& header, const ppu::PackedFrame& thumbnail) {
+	if(state.size() != layout.size()) throw_exc("Save state of {} bytes doesn't match its layout of {}", state.size(), layout.size());
+	std::vector<section_entry> table;
+	std::vector<uint8_t> data;
+	// registers are stored as they are, memory is compressed unless that makes it bigger
+	const auto add = [&table, &data](std::span<const uint8_t> bytes, bool compress) {
+		const size_t begin = data.size();
+		if(compress) {
+			lz::compress(bytes, data);
+			if(data.size() - begin < bytes.size()) {
+				table.push_back({.size = static_cast<uint32_t>(bytes.size()), .stored_size = static_cast<uint32_t>(data.size() - begin)});
+				return;
+			}
+			data.resize(begin);
+		}
+		data.insert(data.end(), bytes.begin(), bytes.end());
+		table.push_back({.size = static_cast<uint32_t>(bytes.size()), .stored_size = static_cast<uint32_t>(bytes.size())});
+	};
+	add(as_bytes(thumbnail), true);
+	for(const auto& section : layout.sections()) add(state.subspan(section.offset, section.size), section.memory);
+
+	file_header h{
+		.magic = {},
+		.version = VERSION,
+		.rom_hash = header.rom_hash,
+		.frame = header.frame,
+		.state_version = header.state_version,
+		.state_size = static_cast<uint32_t>(state.size()),
+		.section_count = static_cast<uint32_t>(table.size()),
+		.reserved = {},
+	};
+	std::memcpy(h.magic, MAGIC, sizeof(h.magic));
+
+	std::vector<uint8_t> ret;
+	ret.reserve(sizeof(h) + table.size() * sizeof(section_entry) + data.size());
+	const auto append = [&ret](std::span<const uint8_t> bytes) { ret.insert(ret.end(), bytes.begin(), bytes.end()); };
+	append(as_bytes(h));
+	for(const auto& entry : table) append(as_bytes(entry));
+	append(data);
+	return ret;
+}
+
+File::File(const std::filesystem::path& path) : file{path} {
+	const auto bytes = file.bytes();
+	const auto h = read_at<file_header>(bytes, 0, "Save state file");
+	if(std::memcmp(h.magic, MAGIC, sizeof(h.magic)) != 0) throw_exc("\"{}\" isn't a save state file", path.string());
+	if(h.version != VERSION) throw_exc("Save state file is version {}, expected {}", h.version, VERSION);
+	if(h.section_count == 0) throw_exc("Save state file has no thumbnail");
+	header = {.rom_hash = h.rom_hash, .frame = h.frame, .state_version = h.state_version, .state_size = h.state_size};
+
+	size_t pos = sizeof(file_header) + size_t{h.section_count} * sizeof(section_entry);
+	uint64_t total = 0;
+	for(uint32_t i = 0; i < h.section_count; ++i) {
+		const auto entry = read_at<section_entry>(bytes, sizeof(file_header) + i * sizeof(section_entry), "Save state file");
+		if(pos > bytes.size() || entry.stored_size > bytes.size() - pos) throw_exc("Save state file cut off at {} bytes", bytes.size());
+		const section s{.stored = bytes.subspan(pos, entry.stored_size), .size = entry.size};
+		pos += entry.stored_size;
+		if(i == 0) {
+			thumbnail_section = s;
+		} else {
+			sections.push_back(s);
+			total += entry.size;
+		}
+	}
+	if(thumbnail_section.size != sizeof(ppu::PackedFrame)) throw_exc("Save state file thumbnail is {} bytes", thumbnail_section.size);
+	if(total != header.state_size) throw_exc("Save state file has {} bytes of state, expected {}", total, header.state_size);
+}
+
+void File::thumbnail(ppu::Frame& out) const {
+	ppu::PackedFrame packed;
+	decode_section(thumbnail_section.stored, {reinterpret_cast<uint8_t*>(&packed), sizeof(packed)});
+	ppu::unpack(packed, out);
+}
+
+void File::decode(std::span<uint8_t> out) const {
+	if(out.size() != header.state_size) throw_exc("Save state buffer is {} bytes, expected {}", out.size(), header.state_size);
+	size_t pos = 0;
+	for(const auto& s : sections) {
+		decode_section(s.stored, out.subspan(pos, s.size));
+		pos += s.size;
+	}
+}
+
+void File::check_compatible(uint64_t rom_hash) const {
+	if(header.rom_hash != rom_hash) throw_exc("Save state is for a different ROM");
+	if(header.state_version != gameboy_emulator::STATE_VERSION) {
+		throw_exc("Save state is from emulator version {}, this is {}", header.state_version, gameboy_emulator::STATE_VERSION);
+	}
+}
+
+void File::load_into(gameboy_emulator& emulator) const {
+	check_compatible(emulator.rom_hash());
+	std::vector<uint8_t> state(header.state_size);
+	decode(state);
+	emulator.load_state(state);
+}
+
+Writer::Writer() = default;
+
+Writer::~Writer() {
+	flush();
+}
+
+void Writer::save(gameboy_emulator& emulator, const std::filesystem::path& path, uint64_t frame) {
+	const auto j = std::make_shared<job>(job{
+		.path = path,
+		.state = emulator.save_state(),
+		.layout = emulator.state_layout(),
+		.header = {.rom_hash = 0, .frame = frame, .state_version = gameboy_emulator::STATE_VERSION, .state_size = 0},
+		.thumbnail = {},
+		.rom = std::as_const(emulator.mmu).get_cartridge().shared_rom(),
+	});
+	j->header.state_size = static_cast<uint32_t>(j->state.size());
+	emulator.export_frame(ppu::FrameFormat::PACKED_2BPP, {reinterpret_cast<uint8_t*>(&j->thumbnail), sizeof(j->thumbnail)});
+	{
+		std::unique_lock lock{mutex};
+		cv.wait(lock, [this]{ return pending_bytes < MAX_PENDING_BYTES; });
+		pending_bytes += j->state.size();
+		pending.push_back(j);
+	}
+	worker.submit([this, j] {
+		write(*j);
+		{
+			std::lock_guard lock{mutex};
+			pending_bytes -= j->state.size();
+			pending.pop_front(); // saves are written in order, so it's this one
+		}
+		cv.notify_all();
+	});
+}
+
+void Writer::flush() {
+	worker.wait();
+}
+
+std::optional<std::vector<uint8_t>> Writer::pending_state(const std::filesystem::path& path) const {
+	std::lock_guard lock{mutex};
+	// the worker only fills in the header, the state isn't touched after save()
+	for(auto it = pending.rbegin(); it != pending.rend(); ++it) {
+		if((*it)->path == path) return (*it)->state;
+	}
+	return std::nullopt;
+}
+
+unsigned Writer::failures() const {
+	std::lock_guard lock{mutex};
+	return failed;
+}
+
+void Writer::write(job& j) {
+	auto tmp_path = j.path;
+	tmp_path += ".tmp";
+	try {
+		if(j.rom != hashed_rom) {
+			Fnv1a64 hash; // same as gameboy_emulator::rom_hash()
+			hash.update(*j.rom);
+			rom_hash = hash.digest();
+			hashed_rom = j.rom;
+		}
+		j.header.rom_hash = rom_hash;
+		const auto bytes = encode(j.state, j.layout, j.header, j.thumbnail);
+		{
+			std::ofstream out{tmp_path, std::ios::binary | std::ios::trunc};
+			if(!out) throw_exc("Failed to open \"{}\" for writing", tmp_path.string());
+			out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+			out.close();
+			if(out.fail()) throw_exc("Failed to write \"{}\"", tmp_path.string());
+		}
+		std::filesystem::rename(tmp_path, j.path);
+		log_debug("Saved state to {}, {} bytes", j.path.string(), bytes.size());
+	} catch (const std::exception& e) {
+		log_error("Failed to save state to {}: {}", j.path.string(), e.what());
+		std::error_code ignored;
+		std::filesystem::remove(tmp_path, ignored);
+		std::lock_guard lock{mutex};
+		++failed;
+	}
+}
+
+}
@@ -0,0 +1,72 @@
+#include <gb/boot.h>
+#include <gb/gb.h>
+#include <gb/ui/ui.h>
+#include <gb/utils/hash.h>
+#include <gb/utils/load_file.h>
+#include <gb/utils/wav_writer.h>
+
+#include <array>
+#include <charconv>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace gb::ui::audio {
+
+// headless: run a ROM for a fixed time, hash the audio it produces, and optionally save it as .wav/.raw.
+// for regression checks on audio without an audio device, the hash is printed as the last line of stdout.
+struct AudioCaptureUI : UI {
+	static constexpr std::string_view name = "audio_capture";
+
+	AudioCaptureUI(int argc, const char* const argv[]) {
+		const char* binary_name = argv[0] ? argv[0] : "<binary>";
+		const auto usage = std::format("Usage: {} audio_capture <boot rom, or - for none> <game rom> <seconds> <output .wav/.raw, or - for none> [save data]", binary_name);
+		if(argc < 6 || argc > 7) throw std::invalid_argument(usage);
+		const std::string_view seconds_arg{argv[4]};
+		double seconds = 0;
+		if(const auto [end, err] = std::from_chars(seconds_arg.data(), seconds_arg.data() + seconds_arg.size(), seconds); err != std::errc{} || end != seconds_arg.data() + seconds_arg.size() || seconds <= 0) {
+			throw std::invalid_argument(usage);
+		}
+		frames = static_cast<unsigned>(seconds * ppu::FRAME_HZ);
+
+		auto bootrom = gb::load_boot_rom(argv[2]);
+		auto cartridgerom = gb::load_file(argv[3]);
+		std::optional<std::vector<uint8_t>> savedata;
+		if(argc >= 7) savedata = gb::load_file(argv[6]);
+		log_info("Loaded files");
+		emulator.emplace(std::move(bootrom), std::move(cartridgerom), std::move(savedata));
+
+		if(std::string_view{argv[5]} != "-") {
+			wav.emplace(argv[5], static_cast<uint32_t>(emulator->apu.sample_rate()), uint16_t{2});
+		}
+	}
+
+	int main_loop() override {
+		std::array<int16_t, 4096> buf;
+		Fnv1a64 hash;
+		uint64_t total_samples = 0;
+		for(unsigned frame = 0; frame < frames; ++frame) {
+			emulator->run_frame();
+			while(const auto count = emulator->read_audio(buf)) {
+				const auto samples = std::span<const int16_t>{buf}.first(2 * count);
+				hash.update_values(samples);
+				if(wav) wav->write(samples);
+				total_samples += count;
+			}
+		}
+		if(wav) wav->close();
+		log_info("{} frames, {} samples at {} Hz", frames, total_samples, emulator->apu.sample_rate());
+		std::cout << std::format("audio hash: {:016x}\n", hash.digest());
+		return 0;
+	}
+
+	unsigned frames = 0;
+	std::optional<gb::gameboy_emulator> emulator;
+	std::optional<WavWriter> wav;
+};
+
+static auto registration [[maybe_unused]] = (UI::register_ui_type(AudioCaptureUI::name, [](int argc, const char* const argv[]){ return std::make_unique<AudioCaptureUI>(argc, argv); }), 0);
+
+}
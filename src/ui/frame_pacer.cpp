@@ -0,0 +1,102 @@
+#include <gb/ui/frame_pacer.h>
+#include <gb/consts.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gb::ui {
+
+FramePacer::FramePacer(double refresh_hz_hint) {
+	if(refresh_hz_hint > 0) period_ns.store(static_cast<uint64_t>(1e9 / refresh_hz_hint), std::memory_order_relaxed);
+}
+
+double FramePacer::refresh_hz() const {
+	if(!warmed_up.load(std::memory_order_acquire)) return 0;
+	return 1e9 / static_cast<double>(period_ns.load(std::memory_order_relaxed));
+}
+
+bool FramePacer::locked() const {
+	const double hz = refresh_hz();
+	return hz > 0 && std::abs(hz / ppu::FRAME_HZ - 1) <= MAX_RATE_DEVIATION;
+}
+
+uint64_t FramePacer::vsync_at_or_after(uint64_t t) const {
+	const uint64_t last = last_vsync_ns.load(std::memory_order_relaxed);
+	const uint64_t period = period_ns.load(std::memory_order_relaxed);
+	if(t <= last) return last;
+	return last + (t - last + period - 1) / period * period;
+}
+
+std::optional<uint64_t> FramePacer::render_start() const {
+	if(!locked()) return std::nullopt;
+	// right after a swap, so the one we're drawing for is the next
+	const uint64_t target = last_vsync_ns.load(std::memory_order_relaxed) + period_ns.load(std::memory_order_relaxed);
+	return target - std::min(target, render_cost_ns.load(std::memory_order_relaxed) + MARGIN_NS);
+}
+
+void FramePacer::on_render_done(uint64_t begin_ns, uint64_t end_ns) {
+	render_cost_ns.store(track_cost(render_cost_ns.load(std::memory_order_relaxed), end_ns - begin_ns), std::memory_order_relaxed);
+}
+
+void FramePacer::on_swap(uint64_t now_ns, bool new_frame) {
+	const uint64_t last = last_vsync_ns.load(std::memory_order_relaxed);
+	uint64_t period = period_ns.load(std::memory_order_relaxed);
+	if(last != 0 && now_ns > last) {
+		const uint64_t interval = now_ns - last;
+		if(period == 0) {
+			period = interval;
+		} else if(interval >= period * 3 / 4 && interval <= period * 5 / 4) {
+			// swap timestamps are jittery, average over a few dozen
+			period = static_cast<uint64_t>(static_cast<int64_t>(period) + (static_cast<int64_t>(interval) - static_cast<int64_t>(period)) / 32);
+			outliers = 0;
+			++swaps;
+		} else {
+			if(interval > period * 3 / 2 && swaps >= WARMUP_SWAPS) missed_vsyncs.fetch_add(1, std::memory_order_relaxed);
+			// a bad hint, or the window moved to another display: start over from what we're seeing
+			if(++outliers >= WARMUP_SWAPS) {
+				period = interval;
+				outliers = 0;
+				swaps = 0;
+				warmed_up.store(false, std::memory_order_release);
+			}
+		}
+	}
+	period_ns.store(period, std::memory_order_relaxed);
+	last_vsync_ns.store(now_ns, std::memory_order_relaxed);
+	if(swaps >= WARMUP_SWAPS) warmed_up.store(true, std::memory_order_release);
+	if(!new_frame) repeated_frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::optional<uint64_t> FramePacer::frame_start(uint64_t now_ns) {
+	if(!locked()) {
+		frame_target = 0;
+		return std::nullopt;
+	}
+	const uint64_t period = period_ns.load(std::memory_order_relaxed);
+	const uint64_t render_cost = render_cost_ns.load(std::memory_order_relaxed);
+	// the frame has to be done before the render thread starts drawing for its vsync
+	const uint64_t lead = frame_cost_ns + render_cost + 2 * MARGIN_NS;
+	// one frame per vsync. if we've fallen behind, skip ahead rather than starting late (the display repeats a frame).
+	uint64_t earliest = now_ns + lead;
+	if(frame_target != 0) earliest = std::max(earliest, frame_target + period / 2);
+	frame_target = vsync_at_or_after(earliest);
+	frame_deadline = frame_target - render_cost - MARGIN_NS;
+	return frame_target - lead;
+}
+
+void FramePacer::on_frame_done(uint64_t begin_ns, uint64_t end_ns) {
+	frame_cost_ns = track_cost(frame_cost_ns, end_ns - begin_ns);
+	if(frame_target != 0 && end_ns > frame_deadline) late_frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+FramePacer::stats FramePacer::take_stats() {
+	return {
+		.refresh_hz = refresh_hz(),
+		.locked = locked(),
+		.late_frames = late_frames.exchange(0, std::memory_order_relaxed),
+		.repeated_frames = repeated_frames.exchange(0, std::memory_order_relaxed),
+		.missed_vsyncs = missed_vsyncs.exchange(0, std::memory_order_relaxed),
+	};
+}
+
+}
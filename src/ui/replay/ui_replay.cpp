@@ -0,0 +1,184 @@
+#include <gb/boot.h>
+#include <gb/gb.h>
+#include <gb/movie.h>
+#include <gb/state_file.h>
+#include <gb/ui/ui.h>
+#include <gb/utils/hash.h>
+#include <gb/utils/load_file.h>
+#include <gb/utils/y4m_writer.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace gb::ui::replay {
+
+// headless: play back an input recording (see movie.h) and hash every frame, or render it to a .y4m video (in parallel,
+// same hash), or jump straight to one frame of it and hash just that one. given a directory, playing back also saves a
+// checkpoint there at every keyframe (<frame>.gbs, see state_file.h), written in the background.
+// the hash is printed as the last line of stdout, so a recording doubles as a regression check.
+// frames are drawn with the given render mode (see ppu::RenderMode), or with check, played back in every mode at once
+// and compared frame by frame.
+struct ReplayUI : UI {
+	static constexpr std::string_view name = "replay";
+
+	static constexpr std::array<std::pair<std::string_view, ppu::RenderMode>, 3> RENDER_MODE_NAMES{{
+		{"inline", ppu::RenderMode::INLINE},
+		{"deferred", ppu::RenderMode::DEFERRED},
+		{"pipelined", ppu::RenderMode::PIPELINED},
+	}};
+
+	ReplayUI(int argc, const char* const argv[]) {
+		const char* binary_name = argv[0] ? argv[0] : "<binary>";
+		const auto usage = std::format("Usage: {} replay <boot rom, or - for none> <game rom> <movie> [frame to seek to, output .y4m, or directory for checkpoints] [inline, deferred, pipelined or check]", binary_name);
+		if(argc < 5 || argc > 7) throw std::invalid_argument(usage);
+		bool has_target = false;
+		for(int i = 5; i < argc; ++i) {
+			const std::string_view arg{argv[i]};
+			uint64_t frame = 0;
+			if(const auto mode = std::ranges::find(RENDER_MODE_NAMES, arg, &decltype(RENDER_MODE_NAMES)::value_type::first); mode != RENDER_MODE_NAMES.end() && i == argc - 1) {
+				render_mode = mode->second;
+				continue;
+			}
+			if(arg == "check" && i == argc - 1) {
+				check_render_modes = true;
+				continue;
+			}
+			if(has_target) throw std::invalid_argument(usage);
+			has_target = true;
+			if(std::filesystem::path{arg}.extension() == ".y4m") {
+				video_path = arg;
+			} else if(std::filesystem::is_directory(arg)) {
+				checkpoint_dir = arg;
+			} else if(const auto [end, err] = std::from_chars(arg.data(), arg.data() + arg.size(), frame); err == std::errc{} && end == arg.data() + arg.size()) {
+				seek_to = frame;
+			} else {
+				throw std::invalid_argument(usage);
+			}
+		}
+		if(check_render_modes && has_target) throw std::invalid_argument("check only plays the whole movie back");
+
+		bootrom = gb::load_boot_rom(argv[2]);
+		cartridgerom = std::make_shared<const std::vector<uint8_t>>(gb::load_file(argv[3]));
+		movie_file = gb::load_file(argv[4]);
+		log_info("Loaded files");
+		movie.emplace(movie_file);
+	}
+
+	int main_loop() override {
+		const auto begin = std::chrono::steady_clock::now();
+		Fnv1a64 hash;
+		const auto hash_frame = [&hash](const ppu::Frame& frame) { hash.update_values(std::span<const ppu::Frame>{&frame, 1}); };
+		uint64_t last_frame = 0;
+		if(check_render_modes) {
+			if(!check(hash_frame, last_frame)) return 1;
+		} else if(video_path) {
+			Y4mWriter video{*video_path};
+			movie::render(*movie, [this] { return make_emulator(); }, [&](uint64_t frame, const ppu::Frame& f) {
+				hash_frame(f);
+				video.write(f);
+				last_frame = frame;
+			});
+			video.close();
+		} else {
+			const auto emulator = make_emulator();
+			emulator->apu.set_output_enabled(false);
+			movie::Player player{*emulator, *movie};
+			if(seek_to) {
+				player.seek(*seek_to);
+				hash_frame(emulator->ppu.cur_frame());
+			}
+			std::optional<state_file::Writer> checkpoints;
+			if(checkpoint_dir) checkpoints.emplace();
+			const auto keyframes = movie->keyframe_frames();
+			auto next_keyframe = keyframes.begin();
+			while(!seek_to && !player.done()) {
+				player.run_frame();
+				hash_frame(emulator->ppu.cur_frame());
+				if(checkpoints && next_keyframe != keyframes.end() && *next_keyframe == player.frame()) {
+					checkpoints->save(*emulator, *checkpoint_dir / std::format("{}.gbs", player.frame()), player.frame());
+					++next_keyframe;
+				}
+			}
+			last_frame = player.frame();
+			if(checkpoints) {
+				checkpoints->flush();
+				if(const auto failed = checkpoints->failures()) throw_exc("{} checkpoints failed to save", failed);
+			}
+		}
+		const std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - begin;
+		log_info("Got to frame {} of {} in {:.1f} ms", last_frame, movie->frames(), took.count());
+		std::cout << std::format("{} hash: {:016x}\n", seek_to ? std::format("frame {}", last_frame) : std::string{"video"}, hash.digest());
+		return 0;
+	}
+
+	// play the movie back in every render mode side by side, false at the first frame that doesn't match the inline one.
+	// the deferred modes only cover the fast renderer (see PPU::set_render_mode()), so frames the movie's renderer drew
+	// accurately are inline everywhere, which is logged.
+	template<typename HashFrame>
+	bool check(const HashFrame& hash_frame, uint64_t& last_frame) const {
+		struct playback {
+			std::unique_ptr<gameboy_emulator> emulator;
+			std::optional<movie::Player> player;
+			uint64_t deferred_frames = 0;
+		};
+		std::array<playback, RENDER_MODE_NAMES.size()> playbacks;
+		for(size_t i = 0; i < playbacks.size(); ++i) {
+			auto& p = playbacks[i];
+			p.emulator = make_emulator(RENDER_MODE_NAMES[i].second);
+			p.emulator->apu.set_output_enabled(false);
+			p.player.emplace(*p.emulator, *movie);
+		}
+		const auto& reference = playbacks.front();
+		while(!reference.player->done()) {
+			for(auto& p : playbacks) {
+				p.player->run_frame();
+				if(p.emulator->ppu.render_mode_in_use() != ppu::RenderMode::INLINE) ++p.deferred_frames;
+			}
+			const auto& frame = reference.emulator->ppu.cur_frame();
+			hash_frame(frame);
+			for(size_t i = 1; i < playbacks.size(); ++i) {
+				if(std::memcmp(&playbacks[i].emulator->ppu.cur_frame(), &frame, sizeof(frame)) == 0) continue;
+				log_error("Frame {} drawn {} doesn't match inline", reference.player->frame(), RENDER_MODE_NAMES[i].first);
+				return false;
+			}
+		}
+		last_frame = reference.player->frame();
+		for(size_t i = 1; i < playbacks.size(); ++i) {
+			log_info("{} frames drawn {} match inline ({} of them deferred)", last_frame, RENDER_MODE_NAMES[i].first, playbacks[i].deferred_frames);
+		}
+		return true;
+	}
+
+	std::unique_ptr<gameboy_emulator> make_emulator() const { return make_emulator(render_mode); }
+
+	std::unique_ptr<gameboy_emulator> make_emulator(ppu::RenderMode mode) const {
+		auto ret = std::make_unique<gameboy_emulator>(bootrom, cartridgerom, std::nullopt);
+		ret->ppu.set_render_mode(mode);
+		return ret;
+	}
+
+	std::vector<uint8_t> bootrom;
+	memory::SharedRom cartridgerom; // shared by all the emulators
+	std::vector<uint8_t> movie_file;
+	std::optional<movie::Movie> movie; // points into movie_file
+	std::optional<uint64_t> seek_to;
+	std::optional<std::filesystem::path> video_path;
+	std::optional<std::filesystem::path> checkpoint_dir;
+	ppu::RenderMode render_mode = ppu::RenderMode::INLINE;
+	bool check_render_modes = false;
+};
+
+static auto registration [[maybe_unused]] = (UI::register_ui_type(ReplayUI::name, [](int argc, const char* const argv[]){ return std::make_unique<ReplayUI>(argc, argv); }), 0);
+
+}
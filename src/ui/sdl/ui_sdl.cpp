@@ -1,7 +1,16 @@
+#include <gb/boot.h>
 #include <gb/gb.h>
+#include <gb/movie.h>
+#include <gb/rewind.h>
+#include <gb/state_file.h>
+#include <gb/ui/frame_pacer.h>
+#include <gb/ui/frame_skipper.h>
 #include <gb/ui/ui.h>
+#include <gb/utils/hash.h>
 #include <gb/utils/load_file.h>
 #include <gb/utils/sdl_log.h>
+#include <gb/utils/spsc_ring.h>
+#include <gb/utils/triple_buffer.h>
 
 #include <glad/gl.h>
 #include <SDL3/SDL.h>
@@ -10,10 +19,17 @@
 #include "imgui_impl_sdl3.h"
 #include "imgui_impl_opengl3.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
 #include <format>
+#include <mutex>
 #include <optional>
 #include <stdexcept>
+#include <string>
 #include <string_view>
+#include <thread>
 
 namespace gb::ui::sdl {
 
@@ -36,62 +52,305 @@ constexpr std::optional<joypad::joypad_bits> translate_keycode(const SDL_Scancod
 
 }
 
+// everything the debugger shows, copied out by the emulation thread between frames so it's consistent.
+struct DebugSnapshot {
+	uint64_t frame = 0;
+	std::string cpu;
+	std::string ppu;
+	std::array<uint8_t, 3> regs{}; // values of DEBUG_REGS
+	joypad::Joypad joypad;
+
+	constexpr static std::array<std::pair<std::string_view, uint16_t>, 3> DEBUG_REGS{{
+		{"INTERRUPT_FLAG", memory::addrs::INTERRUPT_FLAG},
+		{"INTERRUPT_ENABLE", memory::addrs::INTERRUPT_ENABLE},
+		{"JOYPAD", memory::addrs::JOYPAD},
+	}};
+
+	void capture(const gameboy_emulator& emulator, uint64_t frame_num) {
+		using namespace memory::addrs;
+		frame = frame_num;
+		cpu = emulator.cpu.dump_state();
+		ppu = emulator.ppu.dump_state();
+		regs = {emulator.mmu.get<INTERRUPT_FLAG>(), emulator.mmu.get<INTERRUPT_ENABLE>(), emulator.mmu.get<JOYPAD>()};
+		joypad = emulator.get_joypad();
+	}
+};
+
+constexpr std::array<std::pair<ppu::Renderer, const char*>, 3> RENDERER_NAMES{{
+	{ppu::Renderer::AUTO, "auto"},
+	{ppu::Renderer::FAST, "fast"},
+	{ppu::Renderer::ACCURATE, "accurate"},
+}};
+
 // contains useful debugging state.
 // TODO: this should be ported to tui mode?
 // TODO: color binary bits differently in show8 so you can see flickers easily.
 struct Debugger {
 	bool visible{false}; // can be toggled by host ui.
 
-	void handle_frame(const gb::gameboy_emulator& emulator) {
+	// renderer is the choice the emulation thread picks up, see ppu::PPU::set_renderer().
+	void handle_frame(const DebugSnapshot& snapshot, std::atomic<ppu::Renderer>& renderer) {
 		if(!visible) return;
 
 		constexpr static auto show8 = [](const std::string_view label, uint8_t value){
 			ImGui::Text("%s: \t[%s]", label.data(), std::format("{0:#04x} = {0:#010b}", value).c_str());
 		};
-		#define SHOW_MMU(x) show8(std::format(#x " ({:#06x})", memory::addrs::##x), emulator.mmu.get<memory::addrs::##x>());
+		const auto show_reg = [&snapshot](size_t i) {
+			const auto& [name, addr] = DebugSnapshot::DEBUG_REGS[i];
+			show8(std::format("{} ({:#06x})", name, addr), snapshot.regs[i]);
+		};
 
 		ImGui::Begin("Debugger", &visible);
+		ImGui::Text("Frame %llu", static_cast<unsigned long long>(snapshot.frame));
+		ImGui::TextUnformatted("Renderer:");
+		for(const auto& [r, name] : RENDERER_NAMES) {
+			ImGui::SameLine();
+			if(ImGui::RadioButton(name, renderer.load(std::memory_order_relaxed) == r)) renderer.store(r, std::memory_order_relaxed);
+		}
 		if(ImGui::TreeNode("CPU")) {
-			ImGui::TextUnformatted(emulator.cpu.dump_state().c_str());
+			ImGui::TextUnformatted(snapshot.cpu.c_str());
 			ImGui::TreePop();
 		}
 		if(ImGui::TreeNode("PPU")) {
-			ImGui::TextUnformatted(emulator.ppu.dump_state().c_str());
+			ImGui::TextUnformatted(snapshot.ppu.c_str());
 			ImGui::TreePop();
 		}
 		if(ImGui::TreeNode("MMU")) {
-			SHOW_MMU(INTERRUPT_FLAG);
-			SHOW_MMU(INTERRUPT_ENABLE);
+			show_reg(0);
+			show_reg(1);
 			ImGui::TreePop();
 		}
 		if(ImGui::TreeNode("Joypad")) {
-			SHOW_MMU(JOYPAD);
+			show_reg(2);
 			for(uint8_t i = 0; i<8; i++) {
 				const auto joypad_enum = static_cast<joypad::joypad_bits>(i);
-				ImGui::TextUnformatted(std::format("{}: {}", joypad_enum, emulator.get_joypad().read_button(joypad_enum)).c_str());
+				ImGui::TextUnformatted(std::format("{}: {}", joypad_enum, snapshot.joypad.read_button(joypad_enum)).c_str());
 			}
 			ImGui::TreePop();
 		}
 		ImGui::End();
 	}
-	#undef SHOW_MMU
 };
 
-struct SDLGui : UI {
+// plays the APU's output on the default audio device, and paces emulation off of it.
+// the emulation thread pushes into a lock-free ring which SDL's audio thread drains from its callback, so neither side ever waits on the other.
+// dynamic rate control: every frame the APU's sample rate is nudged (by at most MAX_RATE_DEVIATION, too little to hear)
+// to keep the ring near TARGET_LATENCY, so small mismatches between the emulated and host clocks neither underrun nor overflow it.
+// when emulation is locked to the display (a bit off from real time), the rate is centred on what that speed needs.
+class AudioOutput {
+public:
+	constexpr static int SAMPLE_RATE = static_cast<int>(apu::APU::DEFAULT_SAMPLE_RATE);
+	constexpr static int CHANNELS = 2;
+	constexpr static double TARGET_LATENCY = 0.05; // seconds queued right after a frame's samples are pushed
+	constexpr static double MAX_RATE_DEVIATION = 0.005;
+
+	AudioOutput() {
+		if(!SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+			log_warn("No audio: {}", SDL_GetError());
+			return;
+		}
+		const SDL_AudioSpec spec{.format = SDL_AUDIO_S16, .channels = CHANNELS, .freq = SAMPLE_RATE};
+		stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, &AudioOutput::callback, this);
+		if(!stream) {
+			log_warn("No audio device: {}", SDL_GetError());
+			return;
+		}
+		sdl_checked(SDL_ResumeAudioStreamDevice(stream));
+	}
+
+	~AudioOutput() {
+		if(stream) SDL_DestroyAudioStream(stream); // stops the callback
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	}
+
+	AudioOutput(const AudioOutput&) = delete;
+	AudioOutput& operator=(const AudioOutput&) = delete;
+
+	bool enabled() const { return stream != nullptr; }
+
+	// move the samples generated so far into the ring, and pick the APU's sample rate for the next frame.
+	// @param speed how fast emulation is running relative to real time.
+	void push(gameboy_emulator& emulator, double speed = 1) {
+		if(!stream) return;
+		std::array<int16_t, 4096> buf;
+		while(const auto samples = emulator.read_audio(buf)) {
+			// if the ring is full the rest is dropped, rate control will bring it back down
+			ring.push(std::span<const int16_t>{buf}.first(samples * CHANNELS));
+		}
+		// fill relative to the target, -1 (empty) to 1 (twice the target): produce more samples when low, fewer when high.
+		const double fill = static_cast<double>(queued_samples()) / TARGET_SAMPLES - 1;
+		emulator.apu.adjust_sample_rate(SAMPLE_RATE / speed * (1 - MAX_RATE_DEVIATION * std::clamp(fill, -1.0, 1.0)));
+	}
+
+	// wait until there's room for another frame, so emulation runs as fast as the device plays.
+	void wait_for_room() const {
+		constexpr size_t FRAME_SAMPLES = static_cast<size_t>(SAMPLE_RATE / ppu::FRAME_HZ);
+		constexpr size_t LIMIT = TARGET_SAMPLES - FRAME_SAMPLES / 2;
+		if(const auto queued = queued_samples(); queued > LIMIT) {
+			SDL_DelayNS((queued - LIMIT) * SDL_NS_PER_SECOND / SAMPLE_RATE);
+		}
+	}
+
+	// times the device ran dry since the last call.
+	unsigned take_underruns() { return underruns.exchange(0, std::memory_order_relaxed); }
+
+private:
+	constexpr static size_t TARGET_SAMPLES = static_cast<size_t>(TARGET_LATENCY * SAMPLE_RATE);
+
+	size_t queued_samples() const { return ring.size() / CHANNELS; }
+
+	// runs on SDL's audio thread.
+	static void SDLCALL callback(void* userdata, SDL_AudioStream* stream, int additional_amount, [[maybe_unused]] int total_amount) {
+		auto& self = *static_cast<AudioOutput*>(userdata);
+		std::array<int16_t, 1024> buf;
+		for(size_t left = static_cast<size_t>(additional_amount) / sizeof(int16_t); left;) {
+			const size_t want = std::min(left, buf.size()) & ~size_t{CHANNELS - 1};
+			if(!want) break;
+			const size_t got = self.ring.pop(std::span{buf}.first(want));
+			if(got) std::copy_n(buf.begin() + got - CHANNELS, CHANNELS, self.last.begin());
+			if(got < want) { // underrun: hold the last sample instead of clicking to 0
+				for(size_t i = got; i < want; ++i) buf[i] = self.last[i % CHANNELS];
+				self.underruns.fetch_add(1, std::memory_order_relaxed);
+			}
+			SDL_PutAudioStreamData(stream, buf.data(), static_cast<int>(want * sizeof(int16_t)));
+			left -= want;
+		}
+	}
+
+	SDL_AudioStream* stream = nullptr;
+	SpscRing<int16_t> ring{4 * TARGET_SAMPLES * CHANNELS};
+	std::array<int16_t, CHANNELS> last{}; // audio thread only
+	std::atomic<unsigned> underruns{0};
+};
+
+// the GB screen as a GL texture, with storage allocated once. frames are converted straight into a pixel buffer
+// and uploaded from there, alternating between two so we never write into one the GPU may still be reading from.
+// with GL 4.4/ARB_buffer_storage the buffers stay mapped, otherwise each upload maps one (orphaning the old storage).
+// a frame identical to the last one uploaded (lots of them, in menus and text boxes) skips conversion and upload entirely.
+class FrameTexture {
+public:
+	// needs a current context. @param gl_version as returned by gladLoadGL.
+	explicit FrameTexture(int gl_version) {
+		// both are core in later versions than we ask for, so get them by hand
+		const auto newer = [&](int minor) { return GLAD_VERSION_MAJOR(gl_version) > 4 || (GLAD_VERSION_MAJOR(gl_version) == 4 && GLAD_VERSION_MINOR(gl_version) >= minor); };
+		const auto tex_storage = newer(2) || SDL_GL_ExtensionSupported("GL_ARB_texture_storage") ? reinterpret_cast<TexStorage2D>(SDL_GL_GetProcAddress("glTexStorage2D")) : nullptr;
+		const auto buffer_storage = newer(4) || SDL_GL_ExtensionSupported("GL_ARB_buffer_storage") ? reinterpret_cast<BufferStorage>(SDL_GL_GetProcAddress("glBufferStorage")) : nullptr;
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		if(tex_storage) tex_storage(GL_TEXTURE_2D, 1, GL_RGB5_A1, ppu::LCD_WIDTH, ppu::LCD_HEIGHT);
+		else glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB5_A1, ppu::LCD_WIDTH, ppu::LCD_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, nullptr);
+
+		glGenBuffers(static_cast<GLsizei>(pbos.size()), pbos.data());
+		for(size_t i = 0; i < pbos.size(); ++i) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+			if(!buffer_storage) continue; // allocated on each upload
+			buffer_storage(GL_PIXEL_UNPACK_BUFFER, FRAME_BYTES, nullptr, GL_MAP_WRITE_BIT | MAP_PERSISTENT_BIT | MAP_COHERENT_BIT);
+			mapped[i] = static_cast<Texel*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, FRAME_BYTES, GL_MAP_WRITE_BIT | MAP_PERSISTENT_BIT | MAP_COHERENT_BIT));
+			if(!mapped[i]) throw_exc("Failed to map pixel buffer");
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		log_info("Frame uploads: {} texture storage, {} pixel buffers", tex_storage ? "immutable" : "mutable", buffer_storage ? "persistently mapped" : "remapped");
+	}
+
+	~FrameTexture() {
+		for(size_t i = 0; i < pbos.size(); ++i) {
+			if(fences[i]) glDeleteSync(fences[i]);
+			if(mapped[i]) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(static_cast<GLsizei>(pbos.size()), pbos.data());
+		glDeleteTextures(1, &texture);
+	}
+
+	FrameTexture(const FrameTexture&) = delete;
+	FrameTexture& operator=(const FrameTexture&) = delete;
+
+	GLuint id() const { return texture; }
+
+	// @return whether the texture changed.
+	bool upload(const ppu::Frame& frame) {
+		const auto hash = fast_hash({reinterpret_cast<const uint8_t*>(frame.data()), sizeof frame});
+		if(uploaded && hash == last_hash) return false;
+		uploaded = true;
+		last_hash = hash;
+
+		const size_t i = next;
+		next ^= 1;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+		if(mapped[i]) {
+			if(fences[i]) { // normally long done, it was submitted a frame ago
+				glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				glDeleteSync(fences[i]);
+				fences[i] = nullptr;
+			}
+			convert(frame, mapped[i]);
+		} else {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, FRAME_BYTES, nullptr, GL_STREAM_DRAW);
+			auto* const out = static_cast<Texel*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, FRAME_BYTES, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+			if(!out) throw_exc("Failed to map pixel buffer");
+			convert(frame, out);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ppu::LCD_WIDTH, ppu::LCD_HEIGHT, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, nullptr); // from the bound buffer
+		if(mapped[i]) fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // imgui uploads from client memory
+		return true;
+	}
+
+private:
+	using Texel = uint16_t; // RGBA 5551
+	using TexStorage2D = void (GLAD_API_PTR*)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+	using BufferStorage = void (GLAD_API_PTR*)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+	constexpr static GLbitfield MAP_PERSISTENT_BIT = 0x0040, MAP_COHERENT_BIT = 0x0080; // GL 4.4
+	constexpr static GLsizeiptr FRAME_BYTES = ppu::LCD_WIDTH * ppu::LCD_HEIGHT * sizeof(Texel);
+
+	/// colors may not be accurate.
+	/// TODO apply postprocessing with a shader?
+	static void convert(const ppu::Frame& frame, Texel* out) {
+		for(size_t row = 0; row < ppu::LCD_HEIGHT; row++) {
+			Texel* const texrow = out + ((ppu::LCD_HEIGHT - 1) - row) * ppu::LCD_WIDTH; // GL's rows go bottom up
+			for(size_t col = 0; col < ppu::LCD_WIDTH; col++) {
+				const auto& framepix = frame[row][col];
+				const uint16_t translate = 21 - (framepix.raw * 7);
+				const auto translate_dim = translate >> 1; // make red/blue dimmer
+				texrow[col] = static_cast<Texel>((translate_dim << 11) | (translate << 6) | (translate_dim << 1) | 1);
+			}
+		}
+	}
+
+	GLuint texture = 0;
+	std::array<GLuint, 2> pbos{};
+	std::array<Texel*, 2> mapped{}; // null unless persistently mapped
+	std::array<GLsync, 2> fences{}; // the last upload from each persistently mapped buffer
+	size_t next = 0;
+	bool uploaded = false;
+	uint64_t last_hash = 0;
+};
+
+struct SDLGui : UI, joypad::InputSource {
 	static constexpr std::string_view name = "gui";
 
 	SDLGui(int argc, const char* const argv[]) {
 		IMGUI_CHECKVERSION();
 		if(argc < 4 || argc > 5) {
 			const char* binary_name = argv[0] ? argv[0] : "<binary>";
-			throw std::invalid_argument(std::format("Usage: {} gui <boot rom> <game rom> [save data]", binary_name));
+			throw std::invalid_argument(std::format("Usage: {} gui <boot rom, or - for none> <game rom> [save data]", binary_name));
 		}
-		auto bootrom = gb::load_file(argv[2]);
+		auto bootrom = gb::load_boot_rom(argv[2]);
 		auto cartridgerom = gb::load_file(argv[3]);
 		std::optional<std::vector<uint8_t>> savedata;
 		if(argc >= 5) savedata = gb::load_file(argv[4]);
 		log_info("Loaded files");
 		emulator.emplace(std::move(bootrom), std::move(cartridgerom), std::move(savedata));
+		emulator->set_input_source(this);
+		movie_path = std::filesystem::path{argv[3]}.replace_extension(".gbm");
+		quicksave_path = std::filesystem::path{argv[3]}.replace_extension(".gbs");
+		rom_hash = emulator->rom_hash();
 
 		gb::logging::init_sdl_logging();
 
@@ -110,8 +369,20 @@ struct SDLGui : UI {
 		// init SDL + OpenGL
 		window = sdl_checkptr(SDL_CreateWindow("GB", 3 * ppu::LCD_WIDTH, 3 * ppu::LCD_HEIGHT, SDL_WINDOW_OPENGL));
 		context = sdl_checkptr(SDL_GL_CreateContext(window));
-		const int version = gladLoadGL(reinterpret_cast<GLADloadfunc>(SDL_GL_GetProcAddress));
-		log_info("OpenGL version {}.{}", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
+		audio.emplace();
+		if(!audio->enabled()) {
+			log_warn("Pacing emulation off of the system clock");
+			emulator->apu.set_output_enabled(false);
+		}
+		vsync = SDL_GL_SetSwapInterval(1);
+		if(vsync) {
+			const SDL_DisplayMode* mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+			pacer.emplace(mode ? mode->refresh_rate : 0.0);
+		} else {
+			log_warn("No vsync");
+		}
+		gl_version = gladLoadGL(reinterpret_cast<GLADloadfunc>(SDL_GL_GetProcAddress));
+		log_info("OpenGL version {}.{}", GLAD_VERSION_MAJOR(gl_version), GLAD_VERSION_MINOR(gl_version));
 
 		if(!ImGui_ImplSDL3_InitForOpenGL(window, context)) throw_exc();
 		if(!ImGui_ImplOpenGL3_Init()) throw_exc();
@@ -120,49 +391,87 @@ struct SDLGui : UI {
 	int main_loop() override {
 		const ImGuiIO& io = ImGui::GetIO();
 		
-		GLuint texture;
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
+		screen.emplace(gl_version);
 		GLuint fboId = 0;
 		glGenFramebuffers(1, &fboId);
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId);
-		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen->id(), 0);
+
+		// emulation runs on its own thread, so swapping (and waiting for vsync) here never holds it up.
+		// it sends back frames and debugger snapshots through triple buffers, and takes input through a queue.
+		emulation_thread = std::jthread{[this](std::stop_token stop){ emulation_loop(stop); }};
 
 		bool quit = false;
+		const auto handle_event = [&](SDL_Event& e) {
+			ImGui_ImplSDL3_ProcessEvent(&e);
+			// TODO: filter keyboard/mouse events based on whether imgui is active
+			switch(e.type) {
+				case SDL_EVENT_QUIT:
+					quit = true;
+					break;
+				case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+					if(e.window.windowID == SDL_GetWindowID(window)) quit = true;
+					break;
+				case SDL_EVENT_KEY_DOWN:
+					if(io.WantCaptureKeyboard) break;
+					if(e.key.repeat) break;
+					if(const auto translated = translate_keycode(e.key.scancode); translated) send_input(*translated, true, e.key.timestamp);
+					if(e.key.scancode == SDL_SCANCODE_D) {
+						debugger.visible = !debugger.visible;
+					}
+					if(e.key.scancode == SDL_SCANCODE_TAB) speed.store(FAST_FORWARD_SPEEDS[fast_forward_choice], std::memory_order_relaxed);
+					if(e.key.scancode == SDL_SCANCODE_BACKSPACE) rewinding.store(true, std::memory_order_relaxed);
+					if(e.key.scancode == SDL_SCANCODE_R) {
+						const unsigned ahead = (runahead_frames.load(std::memory_order_relaxed) + 1) % (MAX_RUNAHEAD_FRAMES + 1);
+						runahead_frames.store(ahead, std::memory_order_relaxed);
+						log_info("Runahead: {} frames", ahead);
+					}
+					if(e.key.scancode == SDL_SCANCODE_V) {
+						const auto cur = std::ranges::find(RENDERER_NAMES, renderer.load(std::memory_order_relaxed), &decltype(RENDERER_NAMES)::value_type::first);
+						const auto& [next, name] = cur + 1 < RENDERER_NAMES.end() ? *(cur + 1) : RENDERER_NAMES.front();
+						renderer.store(next, std::memory_order_relaxed);
+						log_info("Renderer: {}", name);
+					}
+					if(e.key.scancode == SDL_SCANCODE_M) recording_wanted.store(!recording_wanted.load(std::memory_order_relaxed), std::memory_order_relaxed);
+					if(e.key.scancode == SDL_SCANCODE_F5) quicksave_wanted.store(true, std::memory_order_relaxed);
+					if(e.key.scancode == SDL_SCANCODE_F8) quick_load();
+					if(e.key.scancode == SDL_SCANCODE_GRAVE) {
+						fast_forward_choice = (fast_forward_choice + 1) % FAST_FORWARD_SPEEDS.size();
+						const auto chosen = FAST_FORWARD_SPEEDS[fast_forward_choice];
+						log_info("Fast-forward: {}", chosen == UNCAPPED ? std::string{"uncapped"} : std::format("{}x", chosen));
+						if(speed.load(std::memory_order_relaxed) != 1) speed.store(chosen, std::memory_order_relaxed);
+					}
+					break;
+				case SDL_EVENT_KEY_UP:
+					if(io.WantCaptureKeyboard) break;
+					if(const auto translated = translate_keycode(e.key.scancode); translated) send_input(*translated, false, e.key.timestamp);
+					if(e.key.scancode == SDL_SCANCODE_TAB) speed.store(1, std::memory_order_relaxed);
+					if(e.key.scancode == SDL_SCANCODE_BACKSPACE) rewinding.store(false, std::memory_order_relaxed);
+					break;
+			}
+		};
+
+		uint64_t next_stats_ns = SDL_GetTicksNS() + STATS_INTERVAL_NS;
+		bool was_locked = false;
 		while( quit == false ){
-			for(SDL_Event e; SDL_PollEvent( &e );){ // handle SDL events
-				ImGui_ImplSDL3_ProcessEvent(&e);
-				// TODO: filter keyboard/mouse events based on whether imgui is active
-				switch(e.type) {
-					case SDL_EVENT_QUIT:
-						quit = true;
-						break;
-					case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
-						if(e.window.windowID == SDL_GetWindowID(window)) quit = true;
-						break;
-					case SDL_EVENT_KEY_DOWN:
-						if(io.WantCaptureKeyboard) break;
-						if(e.key.repeat) break;
-						if(const auto translated = translate_keycode(e.key.scancode); translated) emulator->press(*translated);
-						if(e.key.scancode == SDL_SCANCODE_D) {
-							debugger.visible = !debugger.visible;
-						}
-						break;
-					case SDL_EVENT_KEY_UP:
-						if(io.WantCaptureKeyboard) break;
-						if(const auto translated = translate_keycode(e.key.scancode); translated) emulator->release(*translated);
+			for(SDL_Event e; SDL_PollEvent( &e );) handle_event(e);
+			// when locked to the display, hold off drawing until just before the vsync. keep forwarding input meanwhile,
+			// the emulation thread starts its frame somewhere in here and should see everything up to then.
+			if(const auto render_at = pacer ? pacer->render_start() : std::nullopt) {
+				for(uint64_t now_ns; (now_ns = SDL_GetTicksNS()) < *render_at;) {
+					const auto wait_ms = (*render_at - now_ns) / SDL_NS_PER_MS;
+					if(wait_ms == 0) {
+						SDL_DelayNS(*render_at - now_ns);
 						break;
+					}
+					if(SDL_Event e; SDL_WaitEventTimeout(&e, static_cast<Sint32>(wait_ms))) handle_event(e);
 				}
 			}
 
-			// TODO: if this throws, freeze on current screen and let us poke around in debugger?
-			const auto frame_begin = SDL_GetPerformanceCounter();
-			emulator->run_frame();
-			const auto frame_end = SDL_GetPerformanceCounter();
-			gb::log_debug("frame took {} ms", static_cast<double>(frame_end - frame_begin) * 1000 / SDL_GetPerformanceFrequency());
-
 			// Render GB screen
-			prepare_texture();
+			const auto render_begin_ns = SDL_GetTicksNS();
+			const bool new_frame = frames.update();
+			if(new_frame) screen->upload(frames.front());
 			int viewportWidth, viewportHeight;
 			SDL_GetWindowSizeInPixels(window, &viewportWidth, &viewportHeight);
 			glBlitFramebuffer(0, 0, ppu::LCD_WIDTH, ppu::LCD_HEIGHT, 0, 0, viewportWidth, viewportHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
@@ -172,13 +481,31 @@ struct SDLGui : UI {
 				ImGui_ImplSDL3_NewFrame();
 				ImGui::NewFrame();
 
-				debugger.handle_frame(*emulator);
+				want_snapshot.store(debugger.visible, std::memory_order_relaxed);
+				if(debugger.visible) {
+					snapshots.update();
+					debugger.handle_frame(snapshots.front(), renderer);
+				}
 
 				ImGui::Render();
 				ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 			}
 
+			if(pacer) pacer->on_render_done(render_begin_ns, SDL_GetTicksNS());
 			SDL_GL_SwapWindow(window);
+			if(pacer) {
+				const auto now_ns = SDL_GetTicksNS();
+				pacer->on_swap(now_ns, new_frame);
+				if(pacer->locked() != was_locked) {
+					was_locked = !was_locked;
+					if(was_locked) log_info("Locked emulation to the {:.2f} Hz display", pacer->refresh_hz());
+					else log_info("Display not at the emulated frame rate, frames will be repeated/skipped");
+				}
+				if(now_ns >= next_stats_ns) {
+					next_stats_ns = now_ns + STATS_INTERVAL_NS;
+					report_pacing(pacer->take_stats());
+				}
+			}
 
 			if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
 			{
@@ -187,45 +514,342 @@ struct SDLGui : UI {
 				SDL_GL_MakeCurrent(window, context);
 			}
 
-			SDL_Delay(1);
-			// TODO: figure out how to sync <60 Hz emulation to 60 hz screen (more important once audio works)
+			if(!vsync) wait_until_next_frame(render_next_frame_ns); // otherwise SDL_GL_SwapWindow already waited
 		}
 
+		emulation_thread = {}; // stops and joins
 		return 0;
 	}
 
 	~SDLGui() override {
+		emulation_thread = {};
+		screen.reset();
 		ImGui_ImplOpenGL3_Shutdown();
 		ImGui_ImplSDL3_Shutdown();
 		ImGui::DestroyContext();
+		audio.reset();
 		if(context) SDL_GL_DestroyContext(context);
 		if(window) SDL_DestroyWindow(window);
 		SDL_Quit();
 	}
 
 private:
-	/// render the game boy screen to a texture.
-	/// colors may not be accurate.
-	/// TODO apply postprocessing with a shader?
-	void prepare_texture(){
-		const auto& frame = emulator->ppu.cur_frame();
-		std::array<std::array<uint16_t, ppu::LCD_WIDTH>, ppu::LCD_HEIGHT> texdata; // RGBA 5551
-		for(size_t row = 0; row < ppu::LCD_HEIGHT; row++) {
-			for(size_t col = 0; col < ppu::LCD_WIDTH; col++) {
-				const auto& framepix = frame[row][col];
-				auto& texpix = texdata[(ppu::LCD_HEIGHT - 1) - row][col];
-				const uint16_t translate = 21 - (framepix.raw * 7);
-				const auto translate_dim = translate >> 1; // make red/blue dimmer
-				texpix = static_cast<uint16_t>((translate_dim << 11) | (translate << 6) | (translate_dim << 1) | 1);
+	struct input_event {
+		joypad::joypad_bits button;
+		bool pressed;
+		uint64_t timestamp_ns; // when SDL saw it
+	};
+
+	void send_input(joypad::joypad_bits button, bool pressed, uint64_t timestamp_ns) {
+		const input_event event{button, pressed, timestamp_ns};
+		if(!inputs.push({&event, 1})) log_warn("Input queue full, dropping {}", button);
+	}
+
+	// emulation thread: apply whatever input the render thread has forwarded so far.
+	void apply_inputs() {
+		for(input_event event; inputs.pop({&event, 1});) {
+			if(event.pressed) emulator->press(event.button);
+			else emulator->release(event.button);
+			log_debug("{} {} latched {:.2f} ms after it came in", event.button, event.pressed ? "press" : "release", static_cast<double>(SDL_GetTicksNS() - event.timestamp_ns) / SDL_NS_PER_MS);
+		}
+	}
+
+	// emulation thread, whenever the game reads the joypad. the render thread forwards input as soon as it gets it,
+	// so input that came in while a frame was being emulated still makes it into that frame if the game hasn't read the joypad yet.
+	// not while running ahead though, that's all thrown away.
+	void poll([[maybe_unused]] uint64_t mclk) override {
+		if(!running_ahead) apply_inputs();
+	}
+
+	// emulation thread, at the start of a frame: start or stop recording input if M was pressed.
+	void update_recording() {
+		const bool want = recording_wanted.load(std::memory_order_relaxed);
+		if(want == recorder.has_value()) return;
+		if(!want) {
+			recorder.reset();
+			return;
+		}
+		try {
+			recorder.emplace(*emulator, movie_path, this, movie::Granularity::JOYPAD_READ);
+		} catch (const std::exception& e) {
+			log_error("Can't record input: {}", e.what());
+			recording_wanted.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	// render thread: read the quick save and hand it to the emulation thread, so the disk is never waited on there.
+	// one still being written is taken from memory, rather than waiting for it to reach the disk.
+	void quick_load() {
+		try {
+			auto pending = state_writer.pending_state(quicksave_path);
+			std::vector<uint8_t> state;
+			if(pending) {
+				state = std::move(*pending);
+			} else {
+				const state_file::File file{quicksave_path};
+				file.check_compatible(rom_hash);
+				state.resize(file.get_info().state_size);
+				file.decode(state);
+			}
+			std::lock_guard lock{pending_load_mutex};
+			pending_load = std::move(state);
+		} catch (const std::exception& e) {
+			log_error("Can't quick load: {}", e.what());
+		}
+	}
+
+	// emulation thread, at the start of a frame: quick save or load if F5/F8 were pressed.
+	void update_quicksave(uint64_t frame) {
+		if(quicksave_wanted.exchange(false, std::memory_order_relaxed)) {
+			state_writer.save(*emulator, quicksave_path, frame);
+			log_info("Quick saved to {}", quicksave_path.string());
+		}
+		std::optional<std::vector<uint8_t>> state;
+		{
+			std::lock_guard lock{pending_load_mutex};
+			state = std::exchange(pending_load, std::nullopt);
+		}
+		if(!state) return;
+		const auto held = emulator->held_buttons(); // as with rewinding, the buttons stay as they're held now
+		try {
+			emulator->load_state(*state);
+		} catch (const std::exception& e) {
+			log_error("Can't quick load: {}", e.what());
+			return;
+		}
+		emulator->set_buttons(held);
+		log_info("Quick loaded {}", quicksave_path.string());
+		if(recorder) { // a recording can't jump
+			log_warn("Quick loaded, stopped recording input");
+			recording_wanted.store(false, std::memory_order_relaxed);
+			recorder.reset();
+		}
+	}
+
+	// emulation thread: step back a frame. the buttons stay as they're held now, not as they were back then.
+	void rewind_frame() {
+		apply_inputs();
+		const auto held = emulator->held_buttons();
+		if(!rewinder.rewind(*emulator)) return;
+		emulator->set_buttons(held);
+		frames.back() = emulator->ppu.cur_frame();
+		frames.publish();
+	}
+
+	// emulation thread: show the frame n frames on from here, as if the buttons stay as they are, then go back.
+	// hides up to n frames of the game's own input lag (most games take a frame or two to show a button press).
+	// only the last of those frames is drawn, and none of them make any sound.
+	void run_ahead(unsigned n) {
+		const auto begin_ns = SDL_GetTicksNS();
+		runahead_state.resize(emulator->state_size());
+		emulator->save_state(runahead_state);
+		const auto saved_ns = SDL_GetTicksNS();
+		emulator->apu.pause_output();
+		running_ahead = true;
+		for(unsigned i = 1; i <= n; ++i) {
+			emulator->ppu.set_frame_skip(i != n);
+			emulator->run_frame();
+		}
+		frames.back() = emulator->ppu.cur_frame();
+		frames.publish();
+		const auto ran_ns = SDL_GetTicksNS();
+		emulator->load_state(runahead_state);
+		emulator->apu.resume_output();
+		running_ahead = false;
+		runahead_stats.save_ns += saved_ns - begin_ns;
+		runahead_stats.ahead_ns += ran_ns - saved_ns;
+		runahead_stats.load_ns += SDL_GetTicksNS() - ran_ns;
+	}
+
+	struct runahead_timing {
+		unsigned ahead = 0;
+		uint64_t frames = 0;
+		uint64_t frame_ns = 0; // the real frame
+		uint64_t save_ns = 0;
+		uint64_t ahead_ns = 0;
+		uint64_t load_ns = 0;
+	};
+
+	// where the time goes, per frame, in the last STATS_INTERVAL_NS.
+	static void report_runahead(const runahead_timing& t) {
+		if(!t.frames) return;
+		const auto ms = [&t](uint64_t ns) { return static_cast<double>(ns) / static_cast<double>(t.frames) / SDL_NS_PER_MS; };
+		log_info("Runahead {}: per frame {:.2f} ms emulating, {:.3f} ms saving, {:.2f} ms running ahead, {:.3f} ms loading",
+			t.ahead, ms(t.frame_ns), ms(t.save_ns), ms(t.ahead_ns), ms(t.load_ns));
+	}
+
+	// complain about frames that came in late, in the last STATS_INTERVAL_NS.
+	// repeated frames are only a problem when locked, otherwise the display just runs at a different rate.
+	static void report_pacing(const FramePacer::stats& stats) {
+		if(stats.late_frames || stats.missed_vsyncs || (stats.locked && stats.repeated_frames)) {
+			log_warn("Pacing at {:.2f} Hz: {} late frames, {} repeated frames, {} missed vsyncs", stats.refresh_hz, stats.late_frames, stats.repeated_frames, stats.missed_vsyncs);
+		}
+	}
+
+	// sleep until next_ns, then move it on a frame (at the given speed). doesn't try to catch up if we're already late.
+	static void wait_until_next_frame(uint64_t& next_ns, unsigned frame_speed = 1) {
+		next_ns += static_cast<uint64_t>(SDL_NS_PER_SECOND / (ppu::FRAME_HZ * frame_speed));
+		const auto now_ns = SDL_GetTicksNS();
+		if(next_ns > now_ns) SDL_DelayNS(next_ns - now_ns);
+		else next_ns = now_ns;
+	}
+
+	void emulation_loop(std::stop_token stop) {
+		uint64_t frame = 0;
+		uint64_t next_frame_ns = 0;
+		unsigned cur_speed = 1;
+		FrameSkipper skipper{static_cast<uint64_t>(SDL_NS_PER_SECOND / ppu::FRAME_HZ)};
+		uint64_t next_runahead_report_ns = 0;
+		try {
+			while(!stop.stop_requested()) {
+				if(const auto new_speed = speed.load(std::memory_order_relaxed); new_speed != cur_speed) {
+					cur_speed = new_speed;
+					// the ring drains at real time, so audio plays sped up (higher pitched). past a point that's just noise.
+					emulator->apu.set_output_enabled(audio->enabled() && audible(cur_speed));
+					if(const double refresh_hz = pacer ? pacer->refresh_hz() : 0; refresh_hz > 0) {
+						skipper.set_display_period(static_cast<uint64_t>(SDL_NS_PER_SECOND / refresh_hz));
+					}
+				}
+				const bool fast_forward = cur_speed != 1;
+
+				if(rewinding.load(std::memory_order_relaxed)) {
+					if(recorder) { // a recording can only go forwards
+						log_warn("Rewinding, stopped recording input");
+						recording_wanted.store(false, std::memory_order_relaxed);
+						recorder.reset();
+					}
+					rewind_frame();
+					wait_until_next_frame(next_frame_ns);
+					continue;
+				}
+
+				// locked to the display: start as late as we can and still make the vsync, so the input we pick up is fresh
+				const auto start_ns = pacer && !fast_forward ? pacer->frame_start(SDL_GetTicksNS()) : std::nullopt;
+				if(start_ns) {
+					if(const auto now_ns = SDL_GetTicksNS(); *start_ns > now_ns) SDL_DelayNS(*start_ns - now_ns);
+				}
+
+				apply_inputs(); // also latched when the game reads the joypad, but it might be halted waiting for a joypad interrupt
+				if(const auto r = renderer.load(std::memory_order_relaxed); r != emulator->ppu.renderer_requested()) {
+					if(recorder) { // playback uses the renderer from the start, mode 3 timing would change under it
+						log_warn("Switched renderer, stopped recording input");
+						recording_wanted.store(false, std::memory_order_relaxed);
+						recorder.reset();
+					}
+					emulator->ppu.set_renderer(r);
+				}
+				update_quicksave(frame);
+				update_recording();
+				if(recorder) recorder->frame_start();
+
+				const auto frame_begin_ns = SDL_GetTicksNS();
+				// fast-forwarding runs several frames per refresh, don't draw the ones that'll never be shown
+				const bool draw = !fast_forward || skipper.should_draw(frame_begin_ns);
+				const unsigned ahead = fast_forward ? 0 : runahead_frames.load(std::memory_order_relaxed);
+				// drawn even when running ahead shows a later one: it's the picture rewind captures and quick save thumbnails
+				// get, and loading back after running ahead puts it back on the PPU.
+				emulator->ppu.set_frame_skip(!draw);
+				emulator->run_frame();
+				rewinder.capture(*emulator);
+				const auto frame_end_ns = SDL_GetTicksNS();
+				gb::log_debug("frame took {} ms", static_cast<double>(frame_end_ns - frame_begin_ns) / SDL_NS_PER_MS);
+				++frame;
+
+				if(ahead) {
+					if(ahead != runahead_stats.ahead || frame_end_ns >= next_runahead_report_ns) {
+						report_runahead(runahead_stats);
+						runahead_stats = {.ahead = ahead};
+						next_runahead_report_ns = frame_end_ns + STATS_INTERVAL_NS;
+					}
+					runahead_stats.frame_ns += frame_end_ns - frame_begin_ns;
+					++runahead_stats.frames;
+					run_ahead(ahead);
+				}
+				if(draw) {
+					if(!ahead) {
+						frames.back() = emulator->ppu.cur_frame();
+						frames.publish();
+					}
+					if(want_snapshot.load(std::memory_order_relaxed)) {
+						snapshots.back().capture(*emulator, frame);
+						snapshots.publish();
+					}
+				}
+				if(fast_forward) skipper.on_frame_done(draw, frame_begin_ns, SDL_GetTicksNS());
+				else if(pacer) pacer->on_frame_done(frame_begin_ns, SDL_GetTicksNS());
+
+				// how fast we're going relative to real time, for audio rate control
+				double audio_speed = 1;
+				if(start_ns) audio_speed = pacer->refresh_hz() / ppu::FRAME_HZ;
+				else if(audible(cur_speed)) audio_speed = cur_speed;
+				audio->push(*emulator, audio_speed);
+				if(const auto underruns = audio->take_underruns(); underruns && audible(cur_speed)) log_debug("audio underran {} times", underruns);
+				if(start_ns || cur_speed == UNCAPPED) continue; // already paced, or not at all
+				if(emulator->apu.output_is_enabled()) audio->wait_for_room();
+				else wait_until_next_frame(next_frame_ns, cur_speed);
 			}
+		} catch (const std::exception& e) {
+			// freeze on the current screen, so we can still poke around in the debugger.
+			log_error("Emulation stopped: {}", e.what());
+			snapshots.back().capture(*emulator, frame);
+			snapshots.publish();
 		}
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB5_A1, ppu::LCD_WIDTH, ppu::LCD_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, texdata.front().data());
 	}
 
 	std::optional<gb::gameboy_emulator> emulator;
 	Debugger debugger;
 	SDL_Window* window{nullptr};
 	SDL_GLContext context{nullptr};
+	int gl_version = 0;
+	std::optional<FrameTexture> screen; // created by main_loop()
+	std::optional<AudioOutput> audio;
+	bool vsync = false;
+	uint64_t render_next_frame_ns = 0;
+	constexpr static uint64_t STATS_INTERVAL_NS = 5 * SDL_NS_PER_SECOND;
+
+	// hold tab to fast-forward, ` picks the speed.
+	constexpr static unsigned UNCAPPED = 0;
+	constexpr static std::array FAST_FORWARD_SPEEDS{2u, 4u, 16u, UNCAPPED};
+	constexpr static unsigned MAX_AUDIBLE_SPEED = 4;
+	static bool audible(unsigned frame_speed) { return frame_speed != UNCAPPED && frame_speed <= MAX_AUDIBLE_SPEED; }
+	size_t fast_forward_choice = 0;
+
+	// R cycles through how many frames to run ahead. the rest is only touched by the emulation thread.
+	constexpr static unsigned MAX_RUNAHEAD_FRAMES = 4;
+	std::vector<uint8_t> runahead_state;
+	bool running_ahead = false;
+	runahead_timing runahead_stats;
+
+	// hold backspace to rewind. only touched by the emulation thread.
+	constexpr static size_t REWIND_BUDGET_BYTES = 64 << 20;
+	Rewinder rewinder{REWIND_BUDGET_BYTES};
+
+	// M starts and stops recording input to movie_path (next to the game rom, overwriting the last recording).
+	// the recorder is only touched by the emulation thread.
+	std::filesystem::path movie_path;
+	std::optional<movie::Recorder> recorder;
+
+	// F5 quick saves to quicksave_path (next to the game rom), F8 loads it. files are written on the writer's thread,
+	// and read on the render thread, see quick_load().
+	std::filesystem::path quicksave_path;
+	uint64_t rom_hash = 0;
+	state_file::Writer state_writer;
+	std::mutex pending_load_mutex;
+	std::optional<std::vector<uint8_t>> pending_load; // read, waiting for the emulation thread to load it
+
+	// shared between the render thread (this one) and the emulation thread
+	SpscRing<input_event> inputs{64};
+	TripleBuffer<ppu::Frame> frames;
+	TripleBuffer<DebugSnapshot> snapshots;
+	std::atomic<bool> want_snapshot{false};
+	std::atomic<unsigned> speed{1}; // frames per real frame, or UNCAPPED
+	std::atomic<bool> rewinding{false};
+	std::atomic<bool> recording_wanted{false};
+	std::atomic<bool> quicksave_wanted{false};
+	std::atomic<unsigned> runahead_frames{0};
+	std::atomic<ppu::Renderer> renderer{ppu::Renderer::AUTO}; // V or the debugger picks it
+	std::optional<FramePacer> pacer; // only with vsync
+	std::jthread emulation_thread; // started by main_loop()
 };
 
 static auto registration [[maybe_unused]] = (UI::register_ui_type(SDLGui::name, [](int argc, const char* const argv[]){ return std::make_unique<SDLGui>(argc, argv); }), 0);
@@ -1,3 +1,4 @@
+#include <gb/boot.h>
 #include <gb/gb.h>
 #include <gb/ui/ui.h>
 #include <gb/utils/load_file.h>
@@ -14,9 +15,9 @@ struct TUI : UI {
 	TUI(int argc, const char* const argv[]) {
 		if(argc < 4 || argc > 5) {
 			const char* binary_name = argv[0] ? argv[0] : "<binary>";
-			throw std::invalid_argument(std::format("Usage: {} tui <boot rom> <game rom> [save data]", binary_name));
+			throw std::invalid_argument(std::format("Usage: {} tui <boot rom, or - for none> <game rom> [save data]", binary_name));
 		}
-		auto bootrom = gb::load_file(argv[2]);
+		auto bootrom = gb::load_boot_rom(argv[2]);
 		auto cartridgerom = gb::load_file(argv[3]);
 		std::optional<std::vector<uint8_t>> savedata;
 		if(argc >= 5) savedata = gb::load_file(argv[4]);
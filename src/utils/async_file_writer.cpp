@@ -0,0 +1,80 @@
+#include <gb/utils/async_file_writer.h>
+#include <gb/utils/log.h>
+
+#include <algorithm>
+
+namespace gb {
+
+AsyncFileWriter::AsyncFileWriter(const std::filesystem::path& path) : file{path, std::ios::binary | std::ios::trunc} {
+	if(!file) throw_exc("Failed to open \"{}\" for writing", path.string());
+	chunk.reserve(CHUNK_BYTES);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+	try {
+		close();
+	} catch (const std::exception& e) {
+		log_error("Error closing file: {}", e.what());
+	}
+}
+
+void AsyncFileWriter::write(std::span<const uint8_t> data) {
+	total_bytes += data.size();
+	while(!data.empty()) {
+		const size_t count = std::min(data.size(), CHUNK_BYTES - chunk.size());
+		chunk.insert(chunk.end(), data.begin(), data.begin() + static_cast<ptrdiff_t>(count));
+		data = data.subspan(count);
+		if(chunk.size() == CHUNK_BYTES) flush_chunk();
+	}
+}
+
+void AsyncFileWriter::write_at(uint64_t offset, std::span<const uint8_t> data) {
+	flush_chunk();
+	queue({.data = {data.begin(), data.end()}, .offset = offset});
+}
+
+void AsyncFileWriter::flush_chunk() {
+	if(chunk.empty()) return;
+	std::vector<uint8_t> next;
+	{
+		std::lock_guard lock{mutex};
+		if(!spare.empty()) {
+			next = std::move(spare.back());
+			spare.pop_back();
+		}
+	}
+	next.clear();
+	next.reserve(CHUNK_BYTES);
+	std::swap(chunk, next);
+	queue({.data = std::move(next), .offset = std::nullopt});
+}
+
+void AsyncFileWriter::queue(job j) {
+	worker.submit([this, j = std::move(j)]() mutable { write_job(j); });
+}
+
+void AsyncFileWriter::close() {
+	if(closed) return;
+	closed = true;
+	flush_chunk();
+	worker.wait();
+	file.close();
+	if(failed || file.fail()) throw_exc("Failed to write file");
+}
+
+void AsyncFileWriter::write_job(job& j) {
+	if(j.offset) {
+		const auto end = file.tellp();
+		file.seekp(static_cast<std::streamoff>(*j.offset));
+		file.write(reinterpret_cast<const char*>(j.data.data()), static_cast<std::streamsize>(j.data.size()));
+		file.seekp(end);
+	} else {
+		file.write(reinterpret_cast<const char*>(j.data.data()), static_cast<std::streamsize>(j.data.size()));
+	}
+
+	std::lock_guard lock{mutex};
+	if(!file) failed = true;
+	if(!j.offset) spare.push_back(std::move(j.data));
+}
+
+}
@@ -0,0 +1,119 @@
+#include <gb/utils/lz.h>
+#include <gb/utils/log.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace gb::lz {
+
+namespace {
+
+// LZ4's rules for the end of a block: the last 5 bytes are always literals, and the last match starts at least 12
+// bytes before the end. decoders rely on them to copy in big steps.
+constexpr size_t MIN_MATCH = 4, LAST_LITERALS = 5, MATCH_START_LIMIT = 12;
+constexpr size_t MAX_OFFSET = 0xFFFF;
+constexpr unsigned HASH_BITS = 12;
+
+uint32_t read32(const uint8_t* p) {
+	uint32_t ret;
+	std::memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+uint32_t hash4(uint32_t seq) { return (seq * 2'654'435'761u) >> (32 - HASH_BITS); }
+
+// lengths past what fits in the token: 255s, then the rest
+uint8_t* put_length(uint8_t* op, size_t n) {
+	for(; n >= 255; n -= 255) *op++ = 255;
+	*op++ = static_cast<uint8_t>(n);
+	return op;
+}
+
+}
+
+void compress(std::span<const uint8_t> in, std::vector<uint8_t>& out) {
+	const size_t start = out.size();
+	out.resize(start + max_compressed_size(in.size()));
+	uint8_t* op = out.data() + start;
+	const uint8_t* const src = in.data();
+
+	const auto put_sequence = [&op, src](size_t literal_begin, size_t literals, size_t offset, size_t match_len) {
+		uint8_t& token = *op++;
+		token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+		if(literals >= 15) op = put_length(op, literals - 15);
+		std::memcpy(op, src + literal_begin, literals);
+		op += literals;
+		if(!match_len) return; // the last sequence is only literals
+		*op++ = static_cast<uint8_t>(offset);
+		*op++ = static_cast<uint8_t>(offset >> 8);
+		token |= static_cast<uint8_t>(std::min<size_t>(match_len - MIN_MATCH, 15));
+		if(match_len - MIN_MATCH >= 15) op = put_length(op, match_len - MIN_MATCH - 15);
+	};
+
+	size_t anchor = 0; // start of the literals not written yet
+	if(in.size() > MATCH_START_LIMIT) {
+		std::array<uint32_t, 1 << HASH_BITS> table{}; // where each hash of 4 bytes was last seen
+		const size_t match_end_limit = in.size() - LAST_LITERALS;
+		for(size_t pos = 1; pos + MATCH_START_LIMIT <= in.size();) {
+			const uint32_t seq = read32(src + pos);
+			auto& slot = table[hash4(seq)];
+			const size_t candidate = slot;
+			slot = static_cast<uint32_t>(pos);
+			if(pos - candidate > MAX_OFFSET || read32(src + candidate) != seq) {
+				pos += 1 + ((pos - anchor) >> 6); // the longer nothing matches, the bigger the steps
+				continue;
+			}
+			size_t len = MIN_MATCH;
+			while(pos + len < match_end_limit && src[candidate + len] == src[pos + len]) ++len;
+			put_sequence(anchor, pos - anchor, pos - candidate, len);
+			pos += len;
+			anchor = pos;
+		}
+	}
+	put_sequence(anchor, in.size() - anchor, 0, 0);
+	out.resize(static_cast<size_t>(op - out.data()));
+}
+
+void decompress(std::span<const uint8_t> in, std::span<uint8_t> out) {
+	size_t ip = 0, op = 0;
+	const auto get_length = [&in, &ip](size_t n) {
+		uint8_t b;
+		do {
+			if(ip >= in.size()) throw_exc("Compressed data cut off");
+			b = in[ip++];
+			n += b;
+		} while(b == 255);
+		return n;
+	};
+	while(true) {
+		if(ip >= in.size()) throw_exc("Compressed data cut off");
+		const uint8_t token = in[ip++];
+		size_t literals = token >> 4;
+		if(literals == 15) literals = get_length(literals);
+		if(literals > in.size() - ip || literals > out.size() - op) throw_exc("Compressed data is broken");
+		std::memcpy(out.data() + op, in.data() + ip, literals);
+		ip += literals;
+		op += literals;
+		if(ip == in.size()) break; // the last sequence has no match
+
+		if(in.size() - ip < 2) throw_exc("Compressed data cut off");
+		const size_t offset = in[ip] | (in[ip + 1] << 8);
+		ip += 2;
+		size_t len = (token & 15) + MIN_MATCH;
+		if((token & 15) == 15) len = get_length(len);
+		if(offset == 0 || offset > op || len > out.size() - op) throw_exc("Compressed data is broken");
+		// closer than len is a repeating pattern (a run, for offset 1): copy whole periods of it, twice as many each time
+		uint8_t* dst = out.data() + op;
+		const uint8_t* from = dst - offset;
+		for(size_t copied = 0; copied < len;) {
+			const size_t n = std::min(len - copied, copied + offset);
+			std::memcpy(dst + copied, from, n);
+			copied += n;
+		}
+		op += len;
+	}
+	if(op != out.size()) throw_exc("Decompressed to {} bytes, expected {}", op, out.size());
+}
+
+}
@@ -0,0 +1,67 @@
+#include <gb/utils/mapped_file.h>
+#include <gb/utils/log.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gb {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+	const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE) throw_exc("Failed to open \"{}\"", path.string());
+	LARGE_INTEGER file_size;
+	if(!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw_exc("Failed to get the size of \"{}\"", path.string());
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+	if(size) { // empty files can't be mapped
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(mapping) data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	CloseHandle(file); // the mapping keeps it open
+	if(size && !data) {
+		if(mapping) CloseHandle(mapping);
+		throw_exc("Failed to map \"{}\"", path.string());
+	}
+}
+
+MappedFile::~MappedFile() {
+	if(data) UnmapViewOfFile(data);
+	if(mapping) CloseHandle(mapping);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) throw_exc("Failed to open \"{}\"", path.string());
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		throw_exc("Failed to get the size of \"{}\"", path.string());
+	}
+	size = static_cast<size_t>(st.st_size);
+	void* mapped = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr; // empty files can't be mapped
+	close(fd); // the mapping keeps it open
+	if(mapped == MAP_FAILED) throw_exc("Failed to map \"{}\"", path.string());
+	data = static_cast<const uint8_t*>(mapped);
+}
+
+MappedFile::~MappedFile() {
+	if(data) munmap(const_cast<uint8_t*>(data), size);
+}
+
+#endif
+
+}
@@ -0,0 +1,90 @@
+#include <gb/utils/thread_pool.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace gb {
+
+ThreadPool::ThreadPool(unsigned num_threads) {
+	workers.reserve(num_threads);
+	for(unsigned i = 0; i < num_threads; ++i) {
+		workers.emplace_back([this](std::stop_token stop){ worker_loop(stop); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	for(auto& worker : workers) worker.request_stop();
+	cv.notify_all();
+	workers.clear(); // joins
+}
+
+void ThreadPool::submit(TaskGroup& group, std::function<void()> task) {
+	{
+		std::lock_guard group_lock{group.mutex};
+		++group.pending;
+	}
+	{
+		std::lock_guard lock{mutex};
+		tasks.push_back({&group, std::move(task)});
+	}
+	cv.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+	// only help with group's own tasks: anything else could be long, or wait in turn, and hold up whoever's waiting here.
+	while(true) {
+		std::unique_lock lock{mutex};
+		const auto it = std::ranges::find(tasks, &group, &queued_task::group);
+		if(it == tasks.end()) break;
+		auto task = std::move(*it);
+		tasks.erase(it);
+		lock.unlock();
+		run(task);
+	}
+
+	std::unique_lock group_lock{group.mutex};
+	group.cv.wait(group_lock, [&group]{ return group.pending == 0; });
+	if(auto exception = std::exchange(group.exception, nullptr)) std::rethrow_exception(exception);
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+	TaskGroup group;
+	for(size_t i = 0; i < count; ++i) {
+		submit(group, [&fn, i]{ fn(i); });
+	}
+	wait(group);
+}
+
+unsigned ThreadPool::default_num_threads() {
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::worker_loop(std::stop_token stop) {
+	while(true) {
+		std::unique_lock lock{mutex};
+		if(!cv.wait(lock, stop, [this]{ return !tasks.empty(); })) return; // stop requested
+		auto task = std::move(tasks.front());
+		tasks.pop_front();
+		lock.unlock();
+		run(task);
+	}
+}
+
+void ThreadPool::run(queued_task& task) {
+	std::exception_ptr exception;
+	try {
+		task.fn();
+	} catch (...) {
+		exception = std::current_exception();
+	}
+	std::lock_guard group_lock{task.group->mutex};
+	if(exception && !task.group->exception) task.group->exception = exception;
+	if(--task.group->pending == 0) task.group->cv.notify_all();
+}
+
+}
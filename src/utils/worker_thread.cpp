@@ -0,0 +1,46 @@
+#include <gb/utils/worker_thread.h>
+
+#include <utility>
+
+namespace gb {
+
+WorkerThread::WorkerThread() : thread{[this](std::stop_token stop){ loop(stop); }} {}
+
+WorkerThread::~WorkerThread() {
+	wait();
+	thread.request_stop();
+	thread.join();
+}
+
+void WorkerThread::submit(std::function<void()> job) {
+	{
+		std::lock_guard lock{mutex};
+		jobs.push_back(std::move(job));
+	}
+	cv.notify_all();
+}
+
+void WorkerThread::wait() {
+	std::unique_lock lock{mutex};
+	cv.wait(lock, [this]{ return jobs.empty() && !running; });
+}
+
+void WorkerThread::loop(std::stop_token stop) {
+	while(true) {
+		std::unique_lock lock{mutex};
+		if(!cv.wait(lock, stop, [this]{ return !jobs.empty(); })) return; // stop requested
+		auto job = std::move(jobs.front());
+		jobs.pop_front();
+		running = true;
+		lock.unlock();
+
+		job();
+
+		lock.lock();
+		running = false;
+		lock.unlock();
+		cv.notify_all();
+	}
+}
+
+}